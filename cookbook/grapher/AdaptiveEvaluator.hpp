@@ -0,0 +1,297 @@
+#pragma once
+#ifndef AdaptiveEvaluator_H
+#define AdaptiveEvaluator_H
+
+/*
+Progressive, parallel, adaptive sampling of a function y = f(x) for the
+grapher.
+
+A coarse uniform pass is refined where the curve bends or jumps: for every
+three consecutive samples, if the middle one is far from the line through
+its neighbours (relative to the plotted range) both intervals are split.
+Refinement stops at a depth limit or a point budget, so discontinuities do
+not refine forever.
+
+Evaluation is spread over a small pool of worker threads (plus the calling
+thread) and is time sliced: step(budget) evaluates for at most about budget
+seconds and picks up where it left off on the next call, so an expensive
+function refines over several frames instead of stalling one.
+
+If a single call takes longer than Settings::callLimit the function is
+considered pathological and refinement stops with whatever was computed.
+A call that never returns cannot be interrupted safely, so it is not
+guarded against.
+
+The function is called from several threads at once and must not rely on
+static state.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class AdaptiveEvaluator {
+public:
+  using Function = double (*)(double);
+
+  struct Settings {
+    int coarse = 512;          // points of the initial uniform pass
+    int maxPoints = 1 << 16;   // total point budget
+    int maxDepth = 10;         // times an interval of the coarse pass may split
+    double tolerance = 1e-3;   // relative to the y range of the samples
+    double callLimit = 0.005;  // seconds a single call may take
+  };
+
+  explicit AdaptiveEvaluator(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // the calling thread works too
+    for (unsigned i = 1; i < threads; i++) {
+      mWorkers.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ~AdaptiveEvaluator() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mRunning = false;
+    }
+    mStart.notify_all();
+    for (auto& w : mWorkers) w.join();
+  }
+
+  AdaptiveEvaluator(const AdaptiveEvaluator&) = delete;
+  AdaptiveEvaluator& operator=(const AdaptiveEvaluator&) = delete;
+
+  Settings& settings() { return mSettings; }
+
+  // Start evaluating a new function over [x0, x1]. Samples of the previous
+  // function stay available until the coarse pass of this one is complete.
+  void reset(Function f, double x0, double x1) {
+    mFunction = f;
+    mX0 = x0;
+    mX1 = x1;
+    mFresh = true;
+    mDone = (f == nullptr);
+    mSlow = false;
+    mWave.clear();
+  }
+
+  // Evaluate for about budget seconds. Returns true if the samples changed.
+  bool step(double budget) {
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                       std::chrono::duration<double>(budget));
+    bool changed = false;
+    while (!mDone && Clock::now() < deadline) {
+      if (mWave.empty()) {
+        if (mFresh) {
+          coarseWave();
+        } else if (!refineWave()) {
+          mDone = true;
+          break;
+        }
+      }
+
+      evaluateWave(deadline);
+
+      if (mSlow) {
+        // keep what was computed and stop here
+        mWave.erase(std::remove_if(mWave.begin(), mWave.end(),
+                                   [](const Sample& s) { return !s.evaluated; }),
+                    mWave.end());
+        mergeWave();
+        mDone = true;
+        changed = true;
+        break;
+      }
+
+      if (std::all_of(mWave.begin(), mWave.end(),
+                      [](const Sample& s) { return s.evaluated; })) {
+        mergeWave();
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  // true once refinement has converged or was stopped
+  bool done() const { return mDone; }
+  // true if refinement was stopped because a call exceeded callLimit
+  bool slow() const { return mSlow; }
+
+  size_t size() const { return mSamples.size(); }
+  double x(size_t i) const { return mSamples[i].x; }
+  double y(size_t i) const { return mSamples[i].y; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Sample {
+    double x, y;
+    int depth;
+    bool evaluated;
+  };
+
+  void coarseWave() {
+    int n = std::max(2, mSettings.coarse);
+    mWave.resize(n);
+    for (int i = 0; i < n; i++) {
+      double x = mX0 + (mX1 - mX0) * i / (n - 1);
+      mWave[i] = Sample{x, 0, 0, false};
+    }
+  }
+
+  // Queue midpoints of intervals around samples that deviate from a
+  // straight line. Returns false when nothing needs refining.
+  bool refineWave() {
+    size_t n = mSamples.size();
+    if (n < 3) return false;
+
+    double lo = std::numeric_limits<double>::max(), hi = -lo;
+    for (const Sample& s : mSamples) {
+      if (std::isfinite(s.y)) {
+        lo = std::min(lo, s.y);
+        hi = std::max(hi, s.y);
+      }
+    }
+    double range = hi > lo ? hi - lo : 1.0;
+    double tolerance = mSettings.tolerance * range;
+
+    std::vector<char> split(n - 1, 0);
+    for (size_t i = 1; i + 1 < n; i++) {
+      const Sample& a = mSamples[i - 1];
+      const Sample& b = mSamples[i];
+      const Sample& c = mSamples[i + 1];
+      bool refine;
+      if (!std::isfinite(a.y) || !std::isfinite(b.y) || !std::isfinite(c.y)) {
+        // localize where the function stops being finite
+        refine = std::isfinite(a.y) != std::isfinite(c.y) ||
+                 std::isfinite(b.y) != std::isfinite(a.y);
+      } else {
+        double t = (b.x - a.x) / (c.x - a.x);
+        double line = a.y + t * (c.y - a.y);
+        refine = std::abs(b.y - line) > tolerance;
+      }
+      if (refine) split[i - 1] = split[i] = 1;
+    }
+
+    size_t maxPoints = size_t(std::max(0, mSettings.maxPoints));
+    size_t budget = maxPoints > n ? maxPoints - n : 0;
+    for (size_t i = 0; i + 1 < n && mWave.size() < budget; i++) {
+      if (!split[i]) continue;
+      const Sample& a = mSamples[i];
+      const Sample& b = mSamples[i + 1];
+      int depth = std::max(a.depth, b.depth) + 1;
+      if (depth > mSettings.maxDepth) continue;
+      mWave.push_back(Sample{0.5 * (a.x + b.x), 0, depth, false});
+    }
+    return !mWave.empty();
+  }
+
+  void mergeWave() {
+    if (mFresh) {
+      mSamples.swap(mWave);
+      mFresh = false;
+    } else {
+      std::vector<Sample> merged(mSamples.size() + mWave.size());
+      std::merge(mSamples.begin(), mSamples.end(), mWave.begin(), mWave.end(),
+                 merged.begin(),
+                 [](const Sample& a, const Sample& b) { return a.x < b.x; });
+      mSamples.swap(merged);
+    }
+    mWave.clear();
+  }
+
+  // Evaluate the pending samples of the wave on all threads until done or
+  // past the deadline
+  void evaluateWave(Clock::time_point deadline) {
+    mTodo.clear();
+    for (size_t i = 0; i < mWave.size(); i++) {
+      if (!mWave[i].evaluated) mTodo.push_back(i);
+    }
+    if (mTodo.empty()) return;
+
+    mDeadline = deadline;
+    mNext = 0;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mActive = unsigned(mWorkers.size());
+      mJob++;
+    }
+    mStart.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFinished.wait(lock, [this] { return mActive == 0; });
+  }
+
+  void work() {
+    const size_t chunk = 8;
+    auto limit = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(mSettings.callLimit));
+    while (!mSlow) {
+      size_t begin = mNext.fetch_add(chunk);
+      if (begin >= mTodo.size()) break;
+      size_t end = std::min(begin + chunk, mTodo.size());
+      for (size_t k = begin; k < end; k++) {
+        auto before = Clock::now();
+        if (before > mDeadline) return;
+        Sample& s = mWave[mTodo[k]];
+        s.y = mFunction(s.x);
+        s.evaluated = true;
+        if (Clock::now() - before > limit) {
+          mSlow = true;
+          return;
+        }
+      }
+    }
+  }
+
+  void workerLoop() {
+    unsigned job = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStart.wait(lock, [&] { return !mRunning || mJob != job; });
+        if (!mRunning) return;
+        job = mJob;
+      }
+      work();
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mActive--;
+      }
+      mFinished.notify_one();
+    }
+  }
+
+  Settings mSettings;
+  Function mFunction = nullptr;
+  double mX0 = -1, mX1 = 1;
+  bool mFresh = false;
+  bool mDone = true;
+
+  std::vector<Sample> mSamples;  // sorted by x
+  std::vector<Sample> mWave;     // samples being evaluated
+
+  // shared with workers while a wave is evaluated
+  std::vector<size_t> mTodo;
+  std::atomic<size_t> mNext{0};
+  std::atomic<bool> mSlow{false};
+  Clock::time_point mDeadline;
+
+  std::mutex mMutex;
+  std::condition_variable mStart, mFinished;
+  unsigned mJob = 0;
+  unsigned mActive = 0;
+  bool mRunning = true;
+  std::vector<std::thread> mWorkers;
+};
+
+#endif
@@ -1,4 +1,4 @@
 # this may fail on Windows and Linux - FIXME
-set(app_include_dirs)
+set(app_include_dirs ../tcc)
 set(app_link_libs tcc)
 set(app_linker_flags -L/usr/local/lib)
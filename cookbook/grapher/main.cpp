@@ -6,6 +6,8 @@ using std::cout;
 using std::endl;
 using std::vector;
 
+#include "AdaptiveEvaluator.hpp"
+#include "CompileService.hpp"
 #include "libtcc.h"
 
 const char* starterCode = R"(
@@ -37,6 +39,13 @@ struct TCC {
   TCCState* instance = nullptr;
   std::string error;
 
+  TCC() = default;
+  TCC(const TCC&) = delete;
+  TCC& operator=(const TCC&) = delete;
+  ~TCC() {
+    if (instance) tcc_delete(instance);
+  }
+
   bool compile(std::string source) {
     if (instance) tcc_delete(instance);
     instance = tcc_new();
@@ -74,10 +83,15 @@ struct TCC {
 
 void tcc_error_handler(void* tcc, const char* msg) { ((TCC*)tcc)->error = msg; }
 
+// points of the initial uniform pass; the evaluator refines from there
 const int N = 2000;
 
 struct Appp : App {
-  TCC tcc;
+  // compiles edits on a worker thread; the result is picked up in onAnimate
+  CompileService<TCC> compiler;
+  unsigned generation = 0;
+  // samples the compiled function in parallel, a few milliseconds per frame
+  AdaptiveEvaluator evaluator;
   char buffer[10000];
   char error[10000];
   Mesh mesh;
@@ -88,34 +102,45 @@ struct Appp : App {
 
   void onCreate() override {
     mesh.primitive(Mesh::LINE_STRIP);
-    for (int i = 0; i < N; i++) {
-      float x = 2.0f * i / (N - 1) - 1;
-      mesh.vertex(x, 0, 0);
-    }
+    evaluator.settings().coarse = N;
+    compiler.submit(buffer);
+  }
 
-    if (tcc.compile(buffer)) {
-      vector<Vec3f>& vertex(mesh.vertices());
-      for (int i = 0; i < N; i++) {
-        vertex[i].y = tcc(vertex[i].x);
-      }
-    }
+  // copy the evaluator's samples into the mesh
+  void updateMesh() {
+    vector<Vec3f>& vertex(mesh.vertices());
+    size_t n = evaluator.size();
+    vertex.resize(n);
+    for (size_t i = 0; i < n; i++)
+      vertex[i].set(float(evaluator.x(i)), float(evaluator.y(i)), 0);
   }
 
   void onAnimate(double dt) override {
+    // start over for each newly compiled function. the previous function is
+    // not called after this, so it may be freed by the compile service
+    unsigned g = generation;
+    TCC* tcc = compiler.acquire(&g);
+    if (tcc && g != generation) {
+      generation = g;
+      evaluator.reset(tcc->function, -1, 1);
+    }
+    if (evaluator.step(0.008)) updateMesh();
+
     imguiBeginFrame();
 
-    ImGui::Text(tcc.error.c_str());
+    ImGui::Text("%s", compiler.busy() ? "compiling..." : compiler.error().c_str());
+    ImGui::Text("%d points%s", int(evaluator.size()),
+                evaluator.slow()   ? " (stopped: function too slow)"
+                : evaluator.done() ? ""
+                                   : " (refining)");
     ImGui::Separator();
 
     bool update =
         ImGui::InputTextMultiline("", buffer, sizeof(buffer), ImVec2(420, 330));
 
     if (update) {
-      if (tcc.compile(buffer)) {
-        vector<Vec3f>& vertex(mesh.vertices());
-        for (int i = 0; i < N; i++)  //
-          vertex[i].y = tcc(vertex[i].x);
-      }
+      // returns right away; compiled after typing pauses
+      compiler.submit(buffer);
     }
 
     imguiEndFrame();
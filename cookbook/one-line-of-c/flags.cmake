@@ -12,7 +12,7 @@ set(AL_VERBOSE_OUTPUT 1)
 
 # other directories to include. You can use relative paths to the
 # source file being built.
-set(app_include_dirs)
+set(app_include_dirs ../tcc)
 
 # other libraries to link
 set(app_link_libs tcc)
@@ -5,6 +5,9 @@ using namespace al;
 using std::cout;
 using std::endl;
 
+#include <atomic>
+
+#include "CompileService.hpp"
 #include "libtcc.h"
 
 inline float mtof(float m) { return 8.175799f * powf(2.0f, m / 12.0f); }
@@ -32,19 +35,40 @@ char foo(int t) {
 }
 )";
 
+// This is appended to the user's code so that a whole block of samples is
+// rendered inside the compiled code. TCC does not inline, so foo is still
+// called once per sample, but through a direct call: the audio callback makes
+// one indirect call per block instead of one per sample. It goes after the
+// user's code so error line numbers are unchanged.
+const char* blockKernelCode = R"(
+void foo_block(int t0, float gain, float* out, int n) {
+  float scale = gain / 128.0f;
+  for (int i = 0; i < n; i++)
+    out[i] = (char)foo(t0 + i) * scale;
+}
+)";
+
 // Fabrice Bellard's Tiny C Compiler can compile simple C programs quickly and
 // "in memory". Given a string, we create a callable function that generates a
 // sequence of audio samples.
 void tcc_error_handler(void* tcc, const char* msg);
 struct TCC {
   using FunctionPointer = char (*)(int);
+  using BlockFunctionPointer = void (*)(int, float, float*, int);
   FunctionPointer process = nullptr;
+  BlockFunctionPointer processBlock = nullptr;
   TCCState* instance = nullptr;
   std::string error;
 
+  TCC() = default;
+  TCC(const TCC&) = delete;
+  TCC& operator=(const TCC&) = delete;
+  ~TCC() { destroy(); }
+
   void destroy() {
     if (instance) {
       tcc_delete(instance);
+      instance = nullptr;
     }
   }
 
@@ -59,6 +83,7 @@ struct TCC {
     tcc_set_output_type(instance, TCC_OUTPUT_MEMORY);
     //
 
+    source += blockKernelCode;
     if (tcc_compile_string(instance, source.c_str()) == -1) {
       //
       // error string is set by the TCC handler
@@ -76,11 +101,19 @@ struct TCC {
       return false;
     }
 
+    BlockFunctionPointer block =
+        (BlockFunctionPointer)(tcc_get_symbol(instance, "foo_block"));
+    if (block == nullptr) {
+      error = "could not find the symbol 'foo_block'";
+      return false;
+    }
+
     // maybe we should go a step further and try a few calls to see if it
     // crashes
 
     error = "";
     process = foo;
+    processBlock = block;
     return true;
   }
 
@@ -89,6 +122,15 @@ struct TCC {
     char c = process(t);
     return c / 128.0f;
   }
+
+  // render n samples starting at time t0, scaled by gain, into out
+  void render(int t0, float gain, float* out, int n) {
+    if (processBlock == nullptr) {
+      for (int i = 0; i < n; i++) out[i] = 0;
+      return;
+    }
+    processBlock(t0, gain, out, n);
+  }
 };
 void tcc_error_handler(void* tcc, const char* msg) {
   ((TCC*)tcc)->error = msg;
@@ -98,13 +140,13 @@ void tcc_error_handler(void* tcc, const char* msg) {
 }
 
 struct Appp : App {
-  TCC tcc[2];
-  unsigned active = 0;
-  bool shouldSwap = false;
+  // compiles edits on a worker thread and hands the result to onSound. only
+  // one compile runs at a time, which older, non-reentrant libtcc needs
+  CompileService<TCC> compiler;
   char buffer[10000];
   char error[10000];
-  float gain = 0;
-  int t = 0;
+  std::atomic<float> gain{0};
+  std::atomic<int> t{0};
 
   Appp() {
     // start out with some code
@@ -114,7 +156,7 @@ struct Appp : App {
   void onExit() override { imguiShutdown(); }
   void onCreate() override {
     imguiInit();
-    tcc[active].compile(buffer);
+    compiler.submit(buffer);
   }
 
   void onAnimate(double dt) override {
@@ -126,7 +168,9 @@ struct Appp : App {
 
     ImGui::Separator();
 
-    ImGui::InputInt("t", &t);
+    // t is advanced by the audio thread, so edit a copy
+    int tEdit = t;
+    if (ImGui::InputInt("t", &tEdit)) t = tEdit;
 
     ImGui::Separator();
 
@@ -134,14 +178,13 @@ struct Appp : App {
         ImGui::InputTextMultiline("", buffer, sizeof(buffer), ImVec2(640, 480));
 
     if (update) {
-      if (tcc[1 - active].compile(buffer)) {
-        shouldSwap = true;
-      }
+      // returns right away; compiled after typing pauses
+      compiler.submit(buffer);
     }
 
     ImGui::Separator();
 
-    ImGui::Text(tcc[1 - active].error.c_str());
+    ImGui::Text("%s", compiler.busy() ? "compiling..." : compiler.error().c_str());
     imguiEndFrame();
   }
 
@@ -151,19 +194,21 @@ struct Appp : App {
   }
 
   void onSound(AudioIOData& io) override {
-    while (io()) {
-      float s = 0;
-
-      if (shouldSwap) {
-        active = 1 - active;  // the only spot we change this
-        shouldSwap = false;
-      }
-
-      s = gain * tcc[active](t);
-      io.out(0) = s;
-      io.out(1) = s;
-      t++;
+    // latest compiled code; stays alive until the next call to acquire()
+    TCC* tcc = compiler.acquire();
+
+    // render the whole block in compiled code straight into the first
+    // channel, then copy it to the other channels
+    int n = io.framesPerBuffer();
+    float* out = io.outBuffer(0);
+    int t0 = t.fetch_add(n);
+    if (tcc) {
+      tcc->render(t0, gain, out, n);
+    } else {
+      memset(out, 0, n * sizeof(float));
     }
+    for (int c = 1; c < io.channelsOut(); c++)
+      memcpy(io.outBuffer(c), out, n * sizeof(float));
   }
 };
 
@@ -0,0 +1,273 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+/*
+Bounding volume hierarchy for ray picking.
+
+Stores one axis aligned bounding box per item (a data point, a sphere, a
+triangle of a mesh...) and answers "which item does this ray hit first"
+without testing every item. The exact ray/item test is supplied by the
+caller, so the same tree serves points, spheres and meshes:
+
+  BVH bvh;
+  bvh.build(data.size(), [&](size_t i) { return BVH::sphere(data[i], r); });
+  double t;
+  int index = bvh.raycast(ray.o, ray.d, t, [&](size_t i) {
+    return ray.intersectSphere(data[i], r);  // <= 0 means no hit
+  });
+
+When items move, update their bounds with update() (walks up the path of
+a single item) or refit() (recomputes every node bottom up). Refitting keeps
+the tree topology, so after large rearrangements calling build() again gives
+tighter bounds.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class BVH {
+public:
+  struct AABB {
+    float min[3];
+    float max[3];
+
+    AABB() {
+      for (int a = 0; a < 3; a++) {
+        min[a] = std::numeric_limits<float>::max();
+        max[a] = -std::numeric_limits<float>::max();
+      }
+    }
+
+    void extend(const AABB& b) {
+      for (int a = 0; a < 3; a++) {
+        min[a] = std::min(min[a], b.min[a]);
+        max[a] = std::max(max[a], b.max[a]);
+      }
+    }
+
+    float center(int axis) const { return 0.5f * (min[axis] + max[axis]); }
+
+    bool operator==(const AABB& b) const {
+      for (int a = 0; a < 3; a++) {
+        if (min[a] != b.min[a] || max[a] != b.max[a]) return false;
+      }
+      return true;
+    }
+  };
+
+  // Bounds of a sphere, for any vector type with operator[]
+  template <class Vec>
+  static AABB sphere(const Vec& center, float radius) {
+    AABB b;
+    for (int a = 0; a < 3; a++) {
+      b.min[a] = float(center[a]) - radius;
+      b.max[a] = float(center[a]) + radius;
+    }
+    return b;
+  }
+
+  // Bounds of a triangle, for any vector type with operator[]
+  template <class Vec>
+  static AABB triangle(const Vec& p0, const Vec& p1, const Vec& p2) {
+    AABB b;
+    for (int a = 0; a < 3; a++) {
+      b.min[a] = float(std::min({p0[a], p1[a], p2[a]}));
+      b.max[a] = float(std::max({p0[a], p1[a], p2[a]}));
+    }
+    return b;
+  }
+
+  explicit BVH(unsigned leafSize = 4) : mLeafSize(std::max(1u, leafSize)) {}
+
+  // Build the tree for count items. boundsOf(i) must return the AABB of
+  // item i.
+  template <class BoundsFunc>
+  void build(size_t count, BoundsFunc boundsOf) {
+    mBounds.resize(count);
+    mItems.resize(count);
+    mLeafOf.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      mBounds[i] = boundsOf(i);
+      mItems[i] = uint32_t(i);
+    }
+    mNodes.clear();
+    if (count == 0) return;
+    mNodes.reserve(2 * count / mLeafSize + 1);
+    mNodes.emplace_back();
+    buildNode(0, 0, uint32_t(count), -1);
+  }
+
+  size_t size() const { return mBounds.size(); }
+  bool empty() const { return mNodes.empty(); }
+
+  // Change the bounds of a single item and refit its ancestors. Stops
+  // early once a node's bounds are unaffected.
+  void update(size_t item, const AABB& bounds) {
+    mBounds[item] = bounds;
+    int32_t node = mLeafOf[item];
+    while (node >= 0) {
+      AABB b = nodeBounds(mNodes[node]);
+      if (b == mNodes[node].bounds) break;
+      mNodes[node].bounds = b;
+      node = mNodes[node].parent;
+    }
+  }
+
+  // Recompute bounds of every item and node, keeping the tree topology
+  template <class BoundsFunc>
+  void refit(BoundsFunc boundsOf) {
+    for (size_t i = 0; i < mBounds.size(); i++) {
+      mBounds[i] = boundsOf(i);
+    }
+    // children are always stored after their parent
+    for (size_t n = mNodes.size(); n-- > 0;) {
+      mNodes[n].bounds = nodeBounds(mNodes[n]);
+    }
+  }
+
+  // Find the closest item hit by the ray origin + t * dir, t > 0.
+  // intersect(i) returns the hit distance for item i, or a value <= 0 on a
+  // miss. Returns the item index, or -1 if nothing is hit, and stores the
+  // hit distance in tHit.
+  template <class Vec, class IntersectFunc>
+  int raycast(const Vec& origin, const Vec& dir, double& tHit,
+              IntersectFunc intersect) const {
+    tHit = std::numeric_limits<double>::max();
+    if (mNodes.empty()) return -1;
+
+    float o[3], inv[3];
+    for (int a = 0; a < 3; a++) {
+      o[a] = float(origin[a]);
+      inv[a] = 1.0f / float(dir[a]);
+    }
+
+    int hitIndex = -1;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node& node = mNodes[stack[--top]];
+      float tEntry;
+      if (!slab(node.bounds, o, inv, tEntry) || tEntry > tHit) continue;
+
+      if (node.count > 0) {
+        for (uint32_t k = node.first; k < node.first + node.count; k++) {
+          double t = intersect(size_t(mItems[k]));
+          if (t > 0 && t < tHit) {
+            tHit = t;
+            hitIndex = int(mItems[k]);
+          }
+        }
+        continue;
+      }
+
+      // push the far child first so the near one is visited first
+      uint32_t nearChild = node.first, farChild = node.first + 1;
+      if (inv[node.axis] < 0) std::swap(nearChild, farChild);
+      stack[top++] = farChild;
+      stack[top++] = nearChild;
+    }
+    return hitIndex;
+  }
+
+private:
+  struct Node {
+    AABB bounds;
+    // leaf: range in mItems. interior: first child index, count == 0
+    uint32_t first = 0;
+    uint32_t count = 0;
+    int32_t parent = -1;
+    uint8_t axis = 0;
+  };
+
+  // Fill the node at index with items [begin, end), splitting recursively
+  void buildNode(uint32_t index, uint32_t begin, uint32_t end,
+                 int32_t parent) {
+    AABB bounds, centers;
+    for (uint32_t k = begin; k < end; k++) {
+      const AABB& b = mBounds[mItems[k]];
+      bounds.extend(b);
+      AABB c;
+      for (int a = 0; a < 3; a++) c.min[a] = c.max[a] = b.center(a);
+      centers.extend(c);
+    }
+    mNodes[index].bounds = bounds;
+    mNodes[index].parent = parent;
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+      if (centers.max[a] - centers.min[a] >
+          centers.max[axis] - centers.min[axis])
+        axis = a;
+    }
+
+    // all centers coincide, splitting would not separate anything
+    bool degenerate = centers.max[axis] <= centers.min[axis];
+    if (end - begin <= mLeafSize || degenerate) {
+      mNodes[index].first = begin;
+      mNodes[index].count = end - begin;
+      for (uint32_t k = begin; k < end; k++) {
+        mLeafOf[mItems[k]] = int32_t(index);
+      }
+      return;
+    }
+
+    uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(mItems.begin() + begin, mItems.begin() + mid,
+                     mItems.begin() + end, [&](uint32_t a, uint32_t b) {
+                       return mBounds[a].center(axis) <
+                              mBounds[b].center(axis);
+                     });
+
+    // children are allocated as a consecutive pair, so only the first
+    // index needs to be stored
+    uint32_t left = uint32_t(mNodes.size());
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+    mNodes[index].first = left;
+    mNodes[index].count = 0;
+    mNodes[index].axis = uint8_t(axis);
+    buildNode(left, begin, mid, int32_t(index));
+    buildNode(left + 1, mid, end, int32_t(index));
+  }
+
+  AABB nodeBounds(const Node& node) const {
+    AABB b;
+    if (node.count > 0) {
+      for (uint32_t k = node.first; k < node.first + node.count; k++) {
+        b.extend(mBounds[mItems[k]]);
+      }
+    } else {
+      b.extend(mNodes[node.first].bounds);
+      b.extend(mNodes[node.first + 1].bounds);
+    }
+    return b;
+  }
+
+  static bool slab(const AABB& b, const float* o, const float* inv,
+                   float& tEntry) {
+    float tmin = 0.0f;
+    float tmax = std::numeric_limits<float>::max();
+    for (int a = 0; a < 3; a++) {
+      float t0 = (b.min[a] - o[a]) * inv[a];
+      float t1 = (b.max[a] - o[a]) * inv[a];
+      if (t0 > t1) std::swap(t0, t1);
+      tmin = std::max(tmin, t0);
+      tmax = std::min(tmax, t1);
+      if (tmax < tmin) return false;
+    }
+    tEntry = tmin;
+    return true;
+  }
+
+  unsigned mLeafSize;
+  std::vector<Node> mNodes;
+  std::vector<AABB> mBounds;     // per item
+  std::vector<uint32_t> mItems;  // item indices, grouped by leaf
+  std::vector<int32_t> mLeafOf;  // per item, leaf node index
+};
+
+#endif
@@ -3,7 +3,9 @@
 
 Description:
 This example demonstrates how to create a custom pickable that inherits from PickableBB for its
-default functionality and adds a custom child Pickable to interact with an internal dataset
+default functionality and adds a custom child Pickable to interact with an internal dataset.
+Hover picking goes through a BVH over the data points, so it stays fast for large datasets.
+Press space to animate the data points; the BVH is refit as they move.
 
 Author:
 Timothy Wood, April 2020
@@ -19,6 +21,8 @@ Timothy Wood, April 2020
 #include "al/ui/al_PickableManager.hpp"
 #include "al/math/al_Random.hpp"
 
+#include "BVH.hpp"
+
 using namespace al;
 
 // inherit from PickableBB
@@ -28,6 +32,7 @@ struct CustomPickableBB : PickableBB {
   Mesh mesh;
   const float meshSize{ 0.02f };
   int hoverIndex, selectIndex;
+  BVH bvh; // acceleration structure over data, rebuilt or refit when data changes
 
   // Child pickable to interact with some data
   struct DataPickable : Pickable {
@@ -37,16 +42,10 @@ struct CustomPickableBB : PickableBB {
     
     Hit intersect(Rayd r){
       auto ray = transformRayLocal(r);
-      double minT = std::numeric_limits<double>::max();
-      int minIndex = -1;
-      for (int i = 0; i < p->data.size(); i++) {
-        Vec3f& v = p->data[i];
-        auto t = ray.intersectSphere(v, p->meshSize);
-        if (t < minT && t > 0) {
-          minT = t;
-          minIndex = i;
-        }
-      }
+      double minT;
+      int minIndex = p->bvh.raycast(ray.o, ray.d, minT, [&](size_t i) {
+        return ray.intersectSphere(p->data[i], p->meshSize);
+      });
       if (minIndex != -1) {
         return Hit(true, r, minIndex, this);
       } else
@@ -80,6 +79,13 @@ struct CustomPickableBB : PickableBB {
     for(int i=0; i < 100; i++){
       data.push_back(Vec3f(rnd::uniform(), rnd::uniform(), rnd::uniform()));
     }
+    bvh.build(data.size(), [&](size_t i) { return BVH::sphere(data[i], meshSize); });
+  }
+
+  // move a data point and refit only the part of the BVH that contains it
+  void setData(int i, const Vec3f& v){
+    data[i] = v;
+    bvh.update(i, BVH::sphere(v, meshSize));
   }
 
   void draw(Graphics& g){
@@ -109,7 +115,20 @@ struct MyApp : public App {
     pm << pickable;
   }
 
-  void onAnimate(double dt) override {}
+  bool animateData = false;
+
+  void onAnimate(double dt) override {
+    if (!animateData) return;
+    for(int i=0; i < pickable.data.size(); i++){
+      Vec3f v = pickable.data[i] + Vec3f(rnd::uniformS(), rnd::uniformS(), rnd::uniformS()) * 0.2f * dt;
+      pickable.setData(i, v);
+    }
+  }
+
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.key() == ' ') animateData = !animateData;
+    return true;
+  }
 
   void onDraw(Graphics &g) override {
     g.clear(0);
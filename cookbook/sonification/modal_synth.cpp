@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include "al/app/al_App.hpp"
 #include "al/scene/al_PolySynth.hpp"
 
@@ -6,6 +8,12 @@
 #include "Gamma/Filter.h"
 #include "Gamma/Noise.h"
 
+// Uncomment to report allocations, locks and I/O in the audio callback,
+// e.g. the vectors resized in ModalVoice::onTriggerOn(). Notes are triggered
+// in onSound() so that onTriggerOn() runs in the audited callback.
+// #define RTAUDIT
+#include "../../tutorials/synthesis/RtAudit.hpp"
+
 using namespace al;
 
 // Frequency coefficients from:
@@ -58,6 +66,7 @@ struct ModalVoice : public SynthVoice {
   }
 
   void onProcess(AudioIOData &io) override {
+    RTAUDIT_VOICE();
     while (io()) {
       auto ampIt = amps.begin();
       float excitation = noise() * residualEnv();
@@ -73,6 +82,7 @@ struct ModalVoice : public SynthVoice {
   }
 
   void onTriggerOn() override {
+    RTAUDIT_VOICE();
     residualEnv.reset();
     auto &freqs = smallHandBell;
     modes.resize(freqs.size());
@@ -102,14 +112,24 @@ struct ModalVoice : public SynthVoice {
 struct MyApp : public App {
 
   PolySynth synth;
+  // A voice taken by onKeyDown(), to be triggered by onSound()
+  std::atomic<ModalVoice *> pendingVoice{nullptr};
 
   void onInit() override { gam::sampleRate(audioIO().framesPerSecond()); }
 
-  void onSound(AudioIOData &io) override { synth.render(io); }
+  void onSound(AudioIOData &io) override {
+    RTAUDIT_CALLBACK("onSound");
+    if (ModalVoice *voice = pendingVoice.exchange(nullptr)) {
+      synth.triggerOn(voice);
+    }
+    synth.render(io);
+  }
 
   bool onKeyDown(const Keyboard &k) override {
-    auto voice = synth.getVoice<ModalVoice>();
-    synth.triggerOn(voice);
+    if (pendingVoice.load()) {
+      return true; // the previous key has not been played yet
+    }
+    pendingVoice.store(synth.getVoice<ModalVoice>());
     return true;
   }
 };
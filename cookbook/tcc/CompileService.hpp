@@ -0,0 +1,183 @@
+#pragma once
+#ifndef CompileService_H
+#define CompileService_H
+
+/*
+Background compilation with lock-free hot swapping, shared by the TCC based
+cookbook examples (one-line-of-c, grapher).
+
+The GUI thread submits source text on every edit. Edits are debounced and
+compiled on a worker thread, so typing never stalls the frame loop. Each
+successful compile is published atomically; a consumer thread (e.g. the
+audio callback) picks up the latest program with acquire(), which never
+locks or allocates.
+
+Programs that have been replaced are deleted by the worker, but only once
+the consumer has moved on to a newer one: acquire() announces the program
+the consumer is using, and retired programs are kept alive while announced.
+This assumes a single consumer thread.
+
+Program must be default constructible and provide
+
+  bool compile(std::string source);  // true on success
+  std::string error;                 // message for the last failed compile
+
+and release its compiler state in its destructor.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <class Program>
+class CompileService {
+public:
+  explicit CompileService(double debounceSeconds = 0.15)
+      : mDebounce(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(debounceSeconds))) {
+    mWorker = std::thread([this] { run(); });
+  }
+
+  ~CompileService() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mRunning = false;
+    }
+    mCondition.notify_one();
+    mWorker.join();
+    delete mPublished.load();
+    for (Entry* e : mRetired) delete e;
+  }
+
+  CompileService(const CompileService&) = delete;
+  CompileService& operator=(const CompileService&) = delete;
+
+  // Queue source for compilation. Called from the GUI thread. Repeated calls
+  // within the debounce time only compile the latest source.
+  void submit(const std::string& source) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mPending = source;
+      mHasPending = true;
+      mDeadline = Clock::now() + mDebounce;
+    }
+    mCondition.notify_one();
+  }
+
+  // Latest successfully compiled program, or nullptr if there is none yet.
+  // Lock-free; call from the consumer thread only. The returned program
+  // stays valid until the next call to acquire(). If generation is given, it
+  // receives a number that increases with every published program.
+  Program* acquire(unsigned* generation = nullptr) {
+    Entry* e = mPublished.load();
+    Entry* check;
+    // announce before use, and make sure the program was not replaced (and
+    // possibly retired) between reading and announcing it
+    do {
+      check = e;
+      mInUse.store(e);
+      e = mPublished.load();
+    } while (e != check);
+    if (e == nullptr) return nullptr;
+    if (generation) *generation = e->generation;
+    return &e->program;
+  }
+
+  // Error of the most recent compile, empty if it succeeded
+  std::string error() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mError;
+  }
+
+  // true while source is waiting to be compiled or being compiled
+  bool busy() const { return mBusy.load(); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    Program program;
+    unsigned generation = 0;
+  };
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRunning) {
+      if (!mHasPending) {
+        // wake up now and then to free programs the consumer let go of
+        mCondition.wait_for(lock, std::chrono::milliseconds(100));
+        freeRetired();
+        continue;
+      }
+      mBusy = true;
+      if (Clock::now() < mDeadline) {
+        mCondition.wait_until(lock, mDeadline);
+        continue;
+      }
+
+      std::string source;
+      source.swap(mPending);
+      mHasPending = false;
+      lock.unlock();
+
+      Entry* e = new Entry;
+      bool ok = e->program.compile(source);
+      std::string error = e->program.error;
+      if (ok) {
+        e->generation = ++mGeneration;
+        Entry* old = mPublished.exchange(e);
+        if (old) mRetired.push_back(old);
+      } else {
+        delete e;
+      }
+      freeRetired();
+
+      lock.lock();
+      mError = ok ? "" : error;
+      mBusy = mHasPending;
+    }
+  }
+
+  // Worker thread only
+  void freeRetired() {
+    Entry* inUse = mInUse.load();
+    for (size_t i = 0; i < mRetired.size();) {
+      if (mRetired[i] != inUse) {
+        delete mRetired[i];
+        mRetired[i] = mRetired.back();
+        mRetired.pop_back();
+      } else {
+        i++;
+      }
+    }
+  }
+
+  Clock::duration mDebounce;
+
+  // guarded by mMutex
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::string mPending;
+  bool mHasPending = false;
+  Clock::time_point mDeadline;
+  std::string mError;
+  bool mRunning = true;
+
+  // shared with the consumer, sequentially consistent on purpose: the
+  // announce/recheck in acquire() relies on it
+  std::atomic<Entry*> mPublished{nullptr};
+  std::atomic<Entry*> mInUse{nullptr};
+  std::atomic<bool> mBusy{false};
+
+  // worker thread only
+  std::vector<Entry*> mRetired;
+  unsigned mGeneration = 0;
+
+  std::thread mWorker;
+};
+
+#endif
@@ -32,6 +32,10 @@ You should use parameters when you need near instantaneous updates (usually
 good for audio), or if your state is getting large and you don't require
 updating values on every frame.
 
+See 05_delta_state.cpp for sharing very large states, and
+06_state_interpolation.cpp for renderers that run smoothly when states
+arrive irregularly or at a lower rate than the display.
+
 */
 
 #include "Gamma/Oscillator.h"
@@ -0,0 +1,114 @@
+/*
+DistributedAppWithState sends the complete state to every renderer on each
+frame. For states of several megabytes this quickly saturates the network,
+even if only a few values change from one frame to the next.
+
+This example shares a large state (a field of 262144 particles, about 3MB)
+using DeltaStateSync instead. Each frame only the ranges of the state that
+changed are sent, with a keyframe of the whole state once a second so that
+renderers that start late or lose a packet catch up. The keyframe is spread
+over several frames so it does not overflow the socket buffers. States
+larger than one datagram are split and reassembled automatically.
+
+Notice that the application inherits from DistributedApp, not
+DistributedAppWithState, and owns the state itself. The primary calls
+send() and the other nodes call receive() in onAnimate().
+
+To try it on one machine, run two instances of this application. The second
+instance receives the state over the loopback interface. On a cluster,
+replace "127.0.0.1" with the renderers' addresses or the broadcast address
+of the render network.
+
+Watch the console of the primary: most frames send a few kilobytes, and
+each keyframe adds the whole state in about a hundred datagrams per frame.
+*/
+
+#include <memory>
+
+#include "al/app/al_DistributedApp.hpp"
+#include "al/graphics/al_Mesh.hpp"
+#include "al/math/al_Random.hpp"
+
+#include "DeltaStateSync.hpp"
+
+using namespace al;
+
+#define NUM_PARTICLES (512 * 512)
+
+struct LargeState {
+  // plain data only, as the state is copied with memcpy
+  float pos[NUM_PARTICLES][3];
+  float navPos[3];
+  float navQuat[4];
+};
+
+class MyApp : public DistributedApp {
+public:
+  // The state is too large to live on the stack
+  std::unique_ptr<LargeState> state{new LargeState()};
+  DeltaStateSync<LargeState> stateSync;
+  Mesh mesh;
+  int cursor = 0;
+
+  void onCreate() override {
+    if (isPrimary()) {
+      stateSync.initSender({"127.0.0.1"});
+      for (int i = 0; i < NUM_PARTICLES; i++) {
+        state->pos[i][0] = (i % 512) / 256.0f - 1.0f;
+        state->pos[i][1] = (i / 512) / 256.0f - 1.0f;
+        state->pos[i][2] = 0;
+      }
+    } else {
+      stateSync.initReceiver();
+    }
+    nav().pos(0, 0, 3);
+    mesh.primitive(Mesh::POINTS);
+  }
+
+  void onAnimate(double dt) override {
+    if (isPrimary()) {
+      // only one row of the field moves on each frame
+      for (int i = cursor * 512; i < (cursor + 1) * 512; i++) {
+        state->pos[i][2] = rnd::uniformS(0.05f);
+      }
+      cursor = (cursor + 1) % 512;
+      for (int i = 0; i < 3; i++) state->navPos[i] = nav().pos()[i];
+      const Quatd &q = nav().quat();
+      state->navQuat[0] = q.w;
+      state->navQuat[1] = q.x;
+      state->navQuat[2] = q.y;
+      state->navQuat[3] = q.z;
+
+      stateSync.send(*state);
+      if (stateSync.encoder().keyframe()) {
+        std::cout << "keyframe: " << stateSync.encoder().keyframePackets()
+                  << " datagrams" << std::endl;
+      }
+    } else {
+      // receive() only touches the state when a complete frame arrived
+      if (stateSync.receive(*state)) {
+        nav().pos(state->navPos[0], state->navPos[1], state->navPos[2]);
+        nav().quat().set(state->navQuat[0], state->navQuat[1],
+                         state->navQuat[2], state->navQuat[3]);
+      }
+    }
+
+    auto &vertices = mesh.vertices();
+    vertices.resize(NUM_PARTICLES);
+    for (int i = 0; i < NUM_PARTICLES; i++) {
+      vertices[i].set(state->pos[i][0], state->pos[i][1], state->pos[i][2]);
+    }
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear(0);
+    g.color(1);
+    g.draw(mesh);
+  }
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
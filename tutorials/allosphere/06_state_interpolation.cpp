@@ -0,0 +1,121 @@
+/*
+In 04_state.cpp renderers copy the received state straight into their nav and
+drawing parameters. Any irregularity in the arrival of states then shows up
+as stutter, and renderers can not show more different frames than the
+primary produces.
+
+Here the primary stamps every state with its simulation time, and renderers
+hand the states they receive to a StateInterpolator. The interpolator
+reconstructs the state for each displayed frame by interpolating between the
+two states around the display time, which runs slightly behind the primary.
+
+This decouples simulation rate from rendering rate: the primary below only
+simulates 15 times per second, but renderers still move smoothly at their
+own frame rate. A cheaper simulation rate on the primary leaves more time for
+heavier simulations.
+
+Run two instances of this application and move around in the first one
+(the primary). The second one follows smoothly. Press 'i' on the renderer
+to toggle interpolation and compare.
+*/
+
+#include "al/app/al_DistributedApp.hpp"
+#include "al/graphics/al_Mesh.hpp"
+#include "al/graphics/al_Shapes.hpp"
+
+#include "StateInterpolator.hpp"
+
+using namespace al;
+
+struct CommonState {
+  double time = 0; // simulation time the state was produced at
+  float xPosition = 0.0;
+  float mod = 0.5;
+  Nav nav;
+};
+
+class MyApp : public DistributedAppWithState<CommonState> {
+public:
+  Mesh m;
+  bool rising{false};
+
+  // The primary simulates at this rate, regardless of its frame rate
+  double simulationRate = 15.0;
+  double accumulator = 0.0;
+  double simTime = 0.0;
+
+  StateInterpolator<CommonState> interpolator;
+  CommonState displayed;
+  bool interpolate = true;
+
+  void onCreate() override {
+    addIcosphere(m);
+    // Fields listed here are interpolated, others are taken as received
+    interpolator.field(&CommonState::xPosition);
+    interpolator.field(&CommonState::mod);
+    interpolator.field(&CommonState::nav);
+  }
+
+  void onAnimate(double dt) override {
+    if (isPrimary()) {
+      accumulator += dt;
+      while (accumulator >= 1.0 / simulationRate) {
+        accumulator -= 1.0 / simulationRate;
+        simTime += 1.0 / simulationRate;
+        step(1.0 / simulationRate);
+      }
+      displayed = state();
+    } else {
+      interpolator.push(state().time, state());
+      if (!interpolate) {
+        displayed = state();
+      } else if (!interpolator.sample(displayed)) {
+        return; // nothing received yet
+      }
+      nav() = displayed.nav;
+    }
+  }
+
+  // One step of the simulation, only run by the primary
+  void step(double dt) {
+    float factor = 0.5f * dt;
+    if (rising) {
+      state().mod += factor;
+    } else {
+      state().mod -= factor;
+    }
+    if (state().mod > 1.0) {
+      rising = false;
+    } else if (state().mod < 0.0) {
+      rising = true;
+    }
+    state().xPosition = sin(simTime);
+    state().nav = nav();
+    state().time = simTime;
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear(0);
+    g.pushMatrix();
+    g.translate(displayed.xPosition, 0, -4);
+    g.scale(displayed.mod);
+    g.polygonLine();
+    g.draw(m);
+    g.popMatrix();
+  }
+
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.key() == 'i' && !isPrimary()) {
+      interpolate = !interpolate;
+      std::cout << "interpolation " << (interpolate ? "on" : "off")
+                << std::endl;
+    }
+    return true;
+  }
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+State synchronization (04_state.cpp) makes sure every renderer receives the
+same state, but not that they show it at the same time. On a wall of
+projectors driven by several renderers, a renderer that receives a state a
+little late shows the previous frame next to its neighbours' new frame.
+
+This example adds a frame barrier. The primary numbers every frame and
+announces it through a FrameBarrierServer. Each renderer, once the state for
+that frame has arrived, acknowledges it and waits in FrameBarrierClient::arrive()
+until all renderers have done so. They then draw the same frame together.
+
+The primary also measures, per renderer, how long it takes from producing a
+frame to the renderer acknowledging it, and the renderers' frame times. The
+histograms are shown in the primary's GUI, which helps finding out which
+node, and which part of the pipeline, holds the others back.
+
+Run several instances of this application on the same machine to try it out.
+On a cluster, set primaryHost to the address of the primary.
+*/
+
+#include <cfloat>
+#include <string>
+
+#include "al/app/al_DistributedApp.hpp"
+#include "al/graphics/al_Shapes.hpp"
+#include "al/io/al_Imgui.hpp"
+
+#include "FrameBarrier.hpp"
+
+using namespace al;
+
+struct SharedState {
+  uint32_t frame = 0;
+  float angle = 0;
+  Nav nav;
+};
+
+class MyApp : public DistributedAppWithState<SharedState> {
+public:
+  std::string primaryHost = "127.0.0.1";
+  FrameBarrierServer barrierServer;
+  FrameBarrierClient barrierClient;
+  uint32_t lastFrame = 0;
+  Mesh mesh;
+
+  void onCreate() override {
+    addCube(mesh);
+    mesh.primitive(Mesh::LINE_STRIP);
+    nav().pos(0, 0, 4);
+
+    if (isPrimary()) {
+      if (!barrierServer.start()) {
+        std::cerr << "Could not start frame barrier" << std::endl;
+      }
+      imguiInit();
+    } else {
+      barrierClient.start(primaryHost);
+    }
+  }
+
+  void onAnimate(double dt) override {
+    if (isPrimary()) {
+      state().frame++;
+      state().angle += 60 * dt;
+      state().nav = nav();
+      barrierServer.beginFrame(state().frame);
+      drawStats();
+    } else {
+      if (state().frame != lastFrame) {
+        lastFrame = state().frame;
+        // waits for the other renderers
+        barrierClient.arrive(lastFrame);
+      }
+      nav() = state().nav;
+    }
+  }
+
+  void drawStats() {
+    imguiBeginFrame();
+    ImGui::Begin("Frame barrier");
+    LatencyHistogram barrier = barrierServer.barrierTime();
+    ImGui::Text("barrier: mean %.2f ms, max %.2f ms", barrier.mean() * 1000,
+                barrier.max() * 1000);
+    for (auto &node : barrierServer.stats()) {
+      ImGui::Separator();
+      ImGui::Text("%s  frame %u  late %llu", node.name.c_str(), node.lastFrame,
+                  (unsigned long long)node.late);
+      ImGui::Text("latency: mean %.2f ms, jitter %.2f ms",
+                  node.latency.mean() * 1000, node.latency.jitter() * 1000);
+      ImGui::PlotHistogram(("latency##" + node.name).c_str(),
+                           node.latency.counts().data(),
+                           (int)node.latency.counts().size(), 0,
+                           "0 - 32 ms", 0, FLT_MAX, ImVec2(0, 40));
+      ImGui::Text("frame time: mean %.2f ms, jitter %.2f ms",
+                  node.frameTime.mean() * 1000,
+                  node.frameTime.jitter() * 1000);
+      ImGui::PlotHistogram(("frame time##" + node.name).c_str(),
+                           node.frameTime.counts().data(),
+                           (int)node.frameTime.counts().size(), 0,
+                           "0 - 32 ms", 0, FLT_MAX, ImVec2(0, 40));
+    }
+    if (ImGui::Button("Clear")) {
+      barrierServer.clearStats();
+    }
+    ImGui::End();
+    imguiEndFrame();
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear(0);
+    g.pushMatrix();
+    g.rotate(state().angle, 0, 1, 0);
+    g.color(1);
+    g.draw(mesh);
+    g.popMatrix();
+
+    if (isPrimary()) {
+      imguiDraw();
+    }
+  }
+
+  void onExit() override {
+    if (isPrimary()) {
+      barrierServer.stop();
+      imguiShutdown();
+    }
+  }
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
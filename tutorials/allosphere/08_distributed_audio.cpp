@@ -0,0 +1,160 @@
+/*
+Only the node with the CAP_AUDIO_IO capability produces sound, so normally
+all voices of a PolySynth have to be computed on that one machine. This
+example spreads the voices over all the nodes of the cluster.
+
+The audio node runs a DistributedAudioMixer and every other node a
+DistributedAudioRenderer. The mixer's block counter is the clock shared by
+all nodes: each node renders the voices it owns for a block on its own
+thread, a few blocks ahead of the audio node, and sends the block back. The
+audio node adds them to its own voices, sample aligned.
+
+For this to work every node must know which notes to play, and when, ahead
+of time. Here the notes are generated from the shared clock itself: note k
+starts at sample k * NOTE_PERIOD, and is played by node k % nodes, counted
+in the block it starts in. In an application the notes could come from a
+score, or be sent to all nodes as events scheduled a few blocks into the
+future.
+
+Run one instance, then start more: every new instance takes a share of the
+voices. The console of the audio node shows the number of nodes and blocks
+that arrived too late to be played.
+*/
+
+#include <cmath>
+#include <functional>
+
+#include "Gamma/Envelope.h"
+#include "Gamma/Oscillator.h"
+#include "al/app/al_DistributedApp.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+#include "DistributedAudio.hpp"
+
+using namespace al;
+
+#define NOTE_PERIOD 2205 // samples between notes
+#define PARTIALS 32      // sine oscillators per voice
+// Voices allocated up front. A voice lasts about 3 seconds (attack + decay),
+// so at 44.1 kHz up to 3.05 * 44100 / NOTE_PERIOD = 61 notes overlap.
+#define MAX_VOICES 72
+
+// An expensive voice: PARTIALS sines with a slow envelope
+class AdditiveVoice : public SynthVoice {
+public:
+  void set(float frequency) {
+    for (int i = 0; i < PARTIALS; i++) {
+      mPartials[i].freq(frequency * (i + 1));
+    }
+    mEnv.attack(0.05);
+    mEnv.decay(3.0);
+    mEnv.reset();
+  }
+
+  void onProcess(AudioIOData &io) override {
+    while (io()) {
+      float s = 0;
+      for (int i = 0; i < PARTIALS; i++) {
+        s += mPartials[i]() / (i + 1);
+      }
+      s *= mEnv() * 0.02f;
+      io.out(0) += s;
+      io.out(1) += s;
+    }
+    if (mEnv.done()) {
+      free();
+    }
+  }
+
+private:
+  gam::Sine<> mPartials[PARTIALS];
+  gam::AD<> mEnv;
+};
+
+class MyApp : public DistributedApp {
+public:
+  std::string audioHost = "127.0.0.1";
+  PolySynth synth;
+  DistributedAudioMixer mixer;
+  DistributedAudioRenderer renderer;
+  double reportTime = 0;
+
+  void onCreate() override {
+    // Voices are taken on the audio thread, where getVoice() must find a
+    // free one instead of locking and allocating a new one
+    synth.allocatePolyphony<AdditiveVoice>(MAX_VOICES);
+    if (hasCapability(CAP_AUDIO_IO)) {
+      mixer.start(audioIO().framesPerBuffer(), audioIO().channelsOut(),
+                  audioIO().framesPerSecond());
+    } else {
+      // Voices are rendered on the renderer's thread
+      renderer.start(audioHost, [this](AudioIOData &io, uint32_t block) {
+        triggerNotes(block, io.framesPerBuffer(),
+                     [this, block](uint64_t k) {
+                       return renderer.owns(k, block);
+                     });
+        synth.render(io);
+      });
+    }
+  }
+
+  // Trigger the notes starting in this block that this node owns
+  void triggerNotes(uint32_t block, int frames,
+                    std::function<bool(uint64_t)> owns) {
+    uint64_t begin = uint64_t(block) * frames;
+    uint64_t k = (begin + NOTE_PERIOD - 1) / NOTE_PERIOD;
+    for (; k * NOTE_PERIOD < begin + frames; k++) {
+      if (!owns(k)) {
+        continue;
+      }
+      // pentatonic melody from the note number, the same on all nodes
+      static const int scale[] = {0, 2, 4, 7, 9};
+      int note = 48 + 12 * ((k / 5) % 3) + scale[(k * 7) % 5];
+      auto *voice = synth.getVoice<AdditiveVoice>();
+      voice->set(440.0f * powf(2, (note - 69) / 12.0f));
+      synth.triggerOn(voice, int(k * NOTE_PERIOD - begin));
+    }
+  }
+
+  void onSound(AudioIOData &io) override {
+    if (!hasCapability(CAP_AUDIO_IO)) {
+      return;
+    }
+    uint32_t block = mixer.block();
+    triggerNotes(block, io.framesPerBuffer(),
+                 [this, block](uint64_t k) { return mixer.owns(k, block); });
+    synth.render(io);
+    // Add the blocks rendered by the other nodes
+    mixer.mix(io);
+  }
+
+  void onAnimate(double dt) override {
+    reportTime += dt;
+    if (reportTime > 1.0) {
+      reportTime = 0;
+      if (hasCapability(CAP_AUDIO_IO)) {
+        std::cout << mixer.nodes() << " nodes, "
+                  << mixer.missingBlocks() << " blocks late" << std::endl;
+      } else {
+        std::cout << "node " << renderer.node() << " of " << renderer.nodes()
+                  << ", " << renderer.skippedBlocks() << " blocks skipped"
+                  << std::endl;
+      }
+    }
+  }
+
+  void onDraw(Graphics &g) override { g.clear(0); }
+
+  void onExit() override {
+    mixer.stop();
+    renderer.stop();
+  }
+};
+
+int main() {
+  MyApp app;
+  app.configureAudio(44100, 512, 2, 0);
+  gam::sampleRate(44100);
+  app.start();
+  return 0;
+}
@@ -0,0 +1,545 @@
+#pragma once
+#ifndef DeltaStateSync_H
+#define DeltaStateSync_H
+
+/*
+Delta compressed state synchronization for large shared states.
+
+DistributedAppWithState sends the whole state struct every frame. That is
+the right choice for small states, but for states of several megabytes
+where little changes per frame it saturates the network. DeltaStateSync is
+an opt-in alternative:
+
+- the sender compares each snapshot with the previous one, 32 bit word by
+  word, and only sends the ranges that changed
+- every keyframeInterval frames (and when a receiver asks for it) a
+  keyframe of the whole state is made, so late joiners and receivers that
+  lost a packet recover. A keyframe is too large to send at once without
+  overflowing the socket buffers, so its datagrams are spread over the
+  following frames while the deltas keep flowing. Receivers keep the deltas
+  that arrive meanwhile and apply them after the keyframe
+- snapshots are split in datagrams that fit in one Ethernet frame and are
+  reassembled on the receiving side. A frame is only applied once all of
+  its datagrams have arrived, so receivers never see a half updated state
+
+Receivers ask for a keyframe at most once per keyframeInterval frames, and
+the sender makes one keyframe at a time, however many receivers ask.
+
+The encoder and decoder work on plain byte buffers and can be used with any
+transport; DeltaStateSync ties them to a UDP socket.
+
+The state must be a plain struct that can be copied with memcpy, and all
+nodes must share the same architecture, as with DistributedAppWithState.
+A frame can have up to 65535 datagrams, so states up to about 94 MB can be
+shared.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "UdpSocket.hpp"
+
+struct DeltaPacketHeader {
+  uint32_t magic;
+  uint32_t frame;
+  uint32_t baseFrame;  // frame the delta applies to, == frame for keyframes
+  uint32_t stateSize;  // in bytes
+  uint16_t chunk;
+  uint16_t chunkCount;
+  uint16_t rangeCount;
+  uint16_t flags;
+  // followed by rangeCount x { uint32_t wordOffset, wordCount; words... }
+
+  static constexpr uint32_t MAGIC = 0x53444C41;  // "ALDS"
+  static constexpr uint16_t KEYFRAME = 1;
+  static constexpr size_t MAX_CHUNKS = 0xFFFF;
+};
+
+// Sent by receivers that need a keyframe to resynchronize
+static constexpr uint32_t DELTA_KEYFRAME_REQUEST = 0x4B444C41;  // "ALDK"
+
+class StateDeltaEncoder {
+public:
+  explicit StateDeltaEncoder(size_t maxPacket = UdpSocket::safePayload(),
+                             unsigned keyframeInterval = 60)
+      : mMaxPacket(maxPacket),
+        mKeyframeInterval(std::max(1u, keyframeInterval)) {}
+
+  // Largest state that fits in MAX_CHUNKS packets of maxPacket bytes
+  static constexpr size_t maxStateSize(size_t maxPacket) {
+    return DeltaPacketHeader::MAX_CHUNKS *
+           ((maxPacket - sizeof(DeltaPacketHeader) - 8) / 4 * 4);
+  }
+
+  // Encode a snapshot of the state into delta packets. Returns the number
+  // of packets, which are available through packet() and packetSize()
+  // until the next call.
+  //
+  // The first snapshot, and one whose size changed, has no delta;
+  // receivers start over from its keyframe. A keyframe is also made every
+  // keyframeInterval frames or when requested, once the previous one has
+  // been sent. Keyframe packets are sent over the following frames, in
+  // order, with nextKeyframePacket() and keyframePacketSent().
+  //
+  // A state larger than maxStateSize() is not encoded: no packets are
+  // made.
+  size_t encode(const void* state, size_t size) {
+    mKeyframe = false;
+    mDelta.sizes.clear();
+    mDelta.payload = 0;
+    if (size > maxStateSize(mMaxPacket)) return 0;
+
+    size_t words = (size + 3) / 4;
+    mCurrent.resize(words);
+    if (words > 0) mCurrent.back() = 0;  // zero padding past the state
+    std::memcpy(mCurrent.data(), state, size);
+
+    bool restart = mFrame == 0 || size != mSize;
+    if (!restart) {
+      mRanges.clear();
+      diff();
+      // a delta with too many ranges to number its packets
+      restart = !pack(mDelta, size, false);
+    }
+    if (restart ||
+        (keyframePacketsLeft() == 0 &&
+         (mRequestKeyframe || mFrame - mKeyframeFrame >= mKeyframeInterval))) {
+      if (restart) {
+        mDelta.sizes.clear();
+        mDelta.payload = 0;
+      }
+      mRanges.assign(1, {0, uint32_t(words)});
+      pack(mKeyframes, size, true);
+      mKeyframe = true;
+      mKeyframeNext = 0;
+      mKeyframeFrame = mFrame;
+      mRequestKeyframe = false;
+    }
+
+    mPrevious.swap(mCurrent);
+    mSize = size;
+    mFrame++;
+    return mDelta.sizes.size();
+  }
+
+  const uint8_t* packet(size_t i) const {
+    return mDelta.data.data() + i * mMaxPacket;
+  }
+  size_t packetSize(size_t i) const { return mDelta.sizes[i]; }
+
+  // Packets of the current keyframe not sent yet
+  size_t keyframePacketsLeft() const {
+    return mKeyframes.sizes.size() - mKeyframeNext;
+  }
+  const uint8_t* nextKeyframePacket() const {
+    return mKeyframes.data.data() + mKeyframeNext * mMaxPacket;
+  }
+  size_t nextKeyframePacketSize() const {
+    return mKeyframes.sizes[mKeyframeNext];
+  }
+  void keyframePacketSent() { mKeyframeNext++; }
+
+  // Make a keyframe as soon as the current one has been sent
+  void requestKeyframe() { mRequestKeyframe = true; }
+
+  // true if the last encode() made a keyframe
+  bool keyframe() const { return mKeyframe; }
+  // packets of the current keyframe
+  size_t keyframePackets() const { return mKeyframes.sizes.size(); }
+  // bytes of state data (excluding headers) in the last encoded delta
+  size_t payloadBytes() const { return mDelta.payload; }
+
+private:
+  struct Packets {
+    std::vector<uint8_t> data;  // fixed stride of mMaxPacket
+    std::vector<size_t> sizes;
+    size_t payload = 0;
+  };
+
+  // Collect ranges of changed words. Unchanged gaps shorter than a range
+  // header are absorbed into the surrounding ranges.
+  void diff() {
+    const size_t gap = 2;
+    const uint32_t* a = mCurrent.data();
+    const uint32_t* b = mPrevious.data();
+    size_t n = mCurrent.size();
+    size_t i = 0;
+    while (i < n) {
+      // skip unchanged blocks quickly
+      const size_t block = 16;
+      while (i + block <= n && std::memcmp(a + i, b + i, block * 4) == 0)
+        i += block;
+      while (i < n && a[i] == b[i]) i++;
+      if (i == n) break;
+
+      size_t begin = i;
+      size_t end = ++i;  // one past the last changed word
+      while (i < n) {
+        if (a[i] != b[i]) {
+          end = i + 1;
+        } else if (i >= end + gap) {
+          break;
+        }
+        i++;
+      }
+      mRanges.push_back({uint32_t(begin), uint32_t(end - begin)});
+      i = end;
+    }
+  }
+
+  // Pack mRanges of mCurrent into out. Returns false if they need more
+  // than MAX_CHUNKS packets.
+  bool pack(Packets& out, size_t size, bool keyframe) {
+    const size_t rangeHeader = 8;
+    out.sizes.clear();
+    out.payload = 0;
+
+    DeltaPacketHeader header;
+    header.magic = DeltaPacketHeader::MAGIC;
+    header.frame = mFrame;
+    header.baseFrame = keyframe ? mFrame : mFrame - 1;
+    header.stateSize = uint32_t(size);
+    header.flags = keyframe ? DeltaPacketHeader::KEYFRAME : 0;
+
+    uint8_t* p = newPacket(out);
+    size_t used = sizeof(header);
+    uint16_t rangeCount = 0;
+    auto finish = [&]() {
+      header.chunk = uint16_t(out.sizes.size() - 1);
+      header.rangeCount = rangeCount;
+      std::memcpy(p, &header, sizeof(header));
+      out.sizes.back() = used;
+    };
+
+    for (const Range& r : mRanges) {
+      uint32_t offset = r.offset, count = r.count;
+      while (count > 0) {
+        if (used + rangeHeader + 4 > mMaxPacket) {
+          if (out.sizes.size() == DeltaPacketHeader::MAX_CHUNKS) return false;
+          finish();
+          p = newPacket(out);
+          used = sizeof(header);
+          rangeCount = 0;
+        }
+        uint32_t fit = uint32_t((mMaxPacket - used - rangeHeader) / 4);
+        uint32_t take = std::min(count, fit);
+        std::memcpy(p + used, &offset, 4);
+        std::memcpy(p + used + 4, &take, 4);
+        std::memcpy(p + used + rangeHeader, mCurrent.data() + offset, take * 4);
+        used += rangeHeader + take * 4;
+        out.payload += take * 4;
+        rangeCount++;
+        offset += take;
+        count -= take;
+      }
+    }
+    finish();
+
+    // now that the number of packets is known, patch it into every header
+    uint16_t chunkCount = uint16_t(out.sizes.size());
+    for (size_t i = 0; i < out.sizes.size(); i++) {
+      std::memcpy(out.data.data() + i * mMaxPacket +
+                      offsetof(DeltaPacketHeader, chunkCount),
+                  &chunkCount, sizeof(chunkCount));
+    }
+    return true;
+  }
+
+  uint8_t* newPacket(Packets& out) {
+    out.sizes.push_back(0);
+    if (out.data.size() < out.sizes.size() * mMaxPacket)
+      out.data.resize(out.sizes.size() * mMaxPacket);
+    return out.data.data() + (out.sizes.size() - 1) * mMaxPacket;
+  }
+
+  struct Range {
+    uint32_t offset, count;  // in words
+  };
+
+  size_t mMaxPacket;
+  unsigned mKeyframeInterval;
+  uint32_t mFrame = 0;
+  size_t mSize = 0;
+  bool mRequestKeyframe = false;
+  bool mKeyframe = false;
+
+  std::vector<uint32_t> mCurrent, mPrevious;
+  std::vector<Range> mRanges;
+  Packets mDelta;
+  Packets mKeyframes;      // being sent
+  size_t mKeyframeNext = 0;  // next keyframe packet to send
+  uint32_t mKeyframeFrame = 0;
+};
+
+class StateDeltaDecoder {
+public:
+  // Feed a received packet. Returns true when it completed a frame and the
+  // state was updated.
+  bool receive(const void* packet, size_t size) {
+    DeltaPacketHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, packet, sizeof(header));
+    if (header.magic != DeltaPacketHeader::MAGIC ||
+        header.chunk >= header.chunkCount)
+      return false;
+    if (!mSeen || int32_t(header.frame - mNewest) > 0) mNewest = header.frame;
+    mSeen = true;
+
+    // ignore packets of frames older than the state
+    if (mValid && int32_t(header.frame - mFrame) <= 0) return false;
+
+    if (header.flags & DeltaPacketHeader::KEYFRAME) {
+      // while in sync, the deltas are enough
+      if (!needKeyframe() && header.stateSize == mSize) return false;
+      return mKeyframe.add(header, packet, size, mDropped) && applyKeyframe();
+    }
+    return mDelta.add(header, packet, size, mDropped) && applyDelta();
+  }
+
+  bool valid() const { return mValid; }
+  const void* data() const { return mState.data(); }
+  size_t size() const { return mSize; }
+  uint32_t frame() const { return mFrame; }
+  // newest frame a packet was received of
+  uint32_t newestFrame() const { return mNewest; }
+
+  // true until the first keyframe arrived, and after a delta could not be
+  // applied until the next one
+  bool needKeyframe() const { return !mValid || mNeedKeyframe; }
+  uint64_t framesApplied() const { return mApplied; }
+  uint64_t framesDropped() const { return mDropped; }
+
+private:
+  typedef std::vector<std::vector<uint8_t>> Chunks;
+
+  // Datagrams of one frame being reassembled
+  struct Assembly {
+    bool assembling = false;
+    uint32_t frame = 0;
+    size_t received = 0;
+    Chunks chunks;
+    std::vector<char> have;
+
+    // Returns true when the frame is complete
+    bool add(const DeltaPacketHeader& header, const void* packet, size_t size,
+             uint64_t& dropped) {
+      if (!assembling || header.frame != frame) {
+        if (assembling) dropped++;  // a datagram of that frame was lost
+        assembling = true;
+        frame = header.frame;
+        received = 0;
+        chunks.clear();
+        chunks.resize(header.chunkCount);
+        have.assign(header.chunkCount, 0);
+      }
+      if (header.chunkCount != chunks.size() || have[header.chunk]) {
+        return false;
+      }
+      chunks[header.chunk].assign((const uint8_t*)packet,
+                                  (const uint8_t*)packet + size);
+      have[header.chunk] = 1;
+      if (++received < header.chunkCount) return false;
+      assembling = false;
+      return true;
+    }
+  };
+
+  static DeltaPacketHeader headerOf(const Chunks& chunks) {
+    DeltaPacketHeader header;
+    std::memcpy(&header, chunks[0].data(), sizeof(header));
+    return header;
+  }
+
+  bool applyKeyframe() {
+    DeltaPacketHeader header = headerOf(mKeyframe.chunks);
+    mState.assign((header.stateSize + 3) / 4, 0);
+    mSize = header.stateSize;
+    for (const auto& chunk : mKeyframe.chunks) apply(chunk);
+    mFrame = header.frame;
+    mValid = true;
+    mNeedKeyframe = false;
+    mApplied++;
+
+    // catch up with the deltas that arrived while the keyframe was sent
+    while (!mQueue.empty()) {
+      DeltaPacketHeader delta = headerOf(mQueue.front());
+      if (int32_t(delta.frame - mFrame) > 0) {
+        if (delta.baseFrame != mFrame || delta.stateSize != mSize) {
+          mNeedKeyframe = true;  // one was lost, keep the rest for later
+          break;
+        }
+        for (const auto& chunk : mQueue.front()) apply(chunk);
+        mFrame = delta.frame;
+        mApplied++;
+      }
+      popQueue();
+    }
+    return true;
+  }
+
+  bool applyDelta() {
+    DeltaPacketHeader header = headerOf(mDelta.chunks);
+    if (!needKeyframe() && header.baseFrame == mFrame &&
+        header.stateSize == mSize) {
+      for (const auto& chunk : mDelta.chunks) apply(chunk);
+      mFrame = header.frame;
+      mApplied++;
+      return true;
+    }
+    // a previous frame was lost, or the keyframe has not arrived yet: keep
+    // the delta for after the keyframe, up to about one state of them
+    if (mValid) mNeedKeyframe = true;
+    for (const auto& chunk : mDelta.chunks) mQueuedBytes += chunk.size();
+    mQueue.push_back(std::move(mDelta.chunks));
+    mDelta.chunks.clear();
+    while (mQueuedBytes > std::max<size_t>(header.stateSize, 1 << 16)) {
+      popQueue();
+      mDropped++;
+    }
+    return false;
+  }
+
+  void popQueue() {
+    for (const auto& chunk : mQueue.front()) mQueuedBytes -= chunk.size();
+    mQueue.pop_front();
+  }
+
+  void apply(const std::vector<uint8_t>& chunk) {
+    DeltaPacketHeader header;
+    std::memcpy(&header, chunk.data(), sizeof(header));
+    size_t pos = sizeof(header);
+    for (uint16_t r = 0; r < header.rangeCount; r++) {
+      uint32_t offset, count;
+      if (pos + 8 > chunk.size()) return;
+      std::memcpy(&offset, chunk.data() + pos, 4);
+      std::memcpy(&count, chunk.data() + pos + 4, 4);
+      pos += 8;
+      if (pos + size_t(count) * 4 > chunk.size() ||
+          size_t(offset) + count > mState.size())
+        return;
+      std::memcpy(mState.data() + offset, chunk.data() + pos, count * 4);
+      pos += size_t(count) * 4;
+    }
+  }
+
+  std::vector<uint32_t> mState;
+  size_t mSize = 0;
+  uint32_t mFrame = 0;
+  bool mValid = false;
+  bool mNeedKeyframe = false;
+  bool mSeen = false;
+  uint32_t mNewest = 0;
+
+  Assembly mKeyframe, mDelta;
+  std::deque<Chunks> mQueue;  // complete deltas waiting for a keyframe
+  size_t mQueuedBytes = 0;
+
+  uint64_t mApplied = 0, mDropped = 0;
+};
+
+// Delta state synchronization of State over UDP. Call send() on the node
+// that owns the state (usually the primary) and receive() on the others.
+template <class State>
+class DeltaStateSync {
+public:
+  static_assert(sizeof(State) <= StateDeltaEncoder::maxStateSize(
+                                     UdpSocket::safePayload()),
+                "State needs more datagrams than a frame can number");
+
+  // datagramsPerFrame limits what send() sends per frame, deltas and
+  // keyframe datagrams together, so the socket buffers do not overflow
+  explicit DeltaStateSync(unsigned keyframeInterval = 60,
+                          size_t datagramsPerFrame = 100)
+      : mEncoder(UdpSocket::safePayload(), keyframeInterval),
+        mKeyframeInterval(std::max(1u, keyframeInterval)),
+        mDatagramsPerFrame(datagramsPerFrame) {}
+
+  // Send to each host in hosts (names, addresses or broadcast addresses)
+  bool initSender(const std::vector<std::string>& hosts,
+                  uint16_t port = 10200) {
+    if (!mSocket.open()) return false;
+    for (const std::string& host : hosts) {
+      if (!mSocket.addDestination(host, port)) return false;
+    }
+    return true;
+  }
+
+  bool initReceiver(uint16_t port = 10200) { return mSocket.open(port); }
+
+  void send(const State& state) {
+    // keyframe requests from receivers that lost packets
+    uint32_t request;
+    while (mSocket.receive(&request, sizeof(request)) == sizeof(request)) {
+      if (request == DELTA_KEYFRAME_REQUEST) mEncoder.requestKeyframe();
+    }
+
+    size_t packets = mEncoder.encode(&state, sizeof(State));
+    for (size_t i = 0; i < packets; i++) {
+      if (mSocket.send(mEncoder.packet(i), mEncoder.packetSize(i)))
+        mBytesSent += mEncoder.packetSize(i);
+    }
+    // then as much of the keyframe as fits. A datagram the socket did not
+    // take is sent again on the next frame.
+    size_t budget = packets < mDatagramsPerFrame
+                        ? mDatagramsPerFrame - packets
+                        : 1;
+    for (; budget > 0 && mEncoder.keyframePacketsLeft() > 0; budget--) {
+      size_t size = mEncoder.nextKeyframePacketSize();
+      if (!mSocket.send(mEncoder.nextKeyframePacket(), size)) break;
+      mBytesSent += size;
+      mEncoder.keyframePacketSent();
+    }
+  }
+
+  // Apply all pending datagrams. Returns true and copies into state if a
+  // new frame was completed.
+  bool receive(State& state) {
+    bool updated = false, received = false;
+    mBuffer.resize(UdpSocket::safePayload());
+    int size;
+    while ((size = mSocket.receive(mBuffer.data(), mBuffer.size())) >= 0) {
+      mBytesReceived += size;
+      received = true;
+      updated |= mDecoder.receive(mBuffer.data(), size);
+    }
+    // ask for a keyframe, again once per keyframe interval in case the
+    // request or the keyframe was lost
+    uint32_t newest = mDecoder.newestFrame();
+    if (received && mDecoder.needKeyframe() &&
+        (!mRequested || newest - mRequestFrame >= mKeyframeInterval)) {
+      mSocket.reply(&DELTA_KEYFRAME_REQUEST, sizeof(DELTA_KEYFRAME_REQUEST));
+      mRequested = true;
+      mRequestFrame = newest;
+    }
+    if (updated) {
+      if (mDecoder.size() == sizeof(State)) {
+        std::memcpy((void*)&state, mDecoder.data(), sizeof(State));
+      }
+    }
+    return updated;
+  }
+
+  StateDeltaEncoder& encoder() { return mEncoder; }
+  StateDeltaDecoder& decoder() { return mDecoder; }
+  // bytes the socket accepted, and bytes received
+  uint64_t bytesSent() const { return mBytesSent; }
+  uint64_t bytesReceived() const { return mBytesReceived; }
+
+private:
+  UdpSocket mSocket;
+  StateDeltaEncoder mEncoder;
+  StateDeltaDecoder mDecoder;
+  unsigned mKeyframeInterval;
+  size_t mDatagramsPerFrame;
+  std::vector<uint8_t> mBuffer;
+  bool mRequested = false;
+  uint32_t mRequestFrame = 0;
+  uint64_t mBytesSent = 0, mBytesReceived = 0;
+};
+
+#endif
@@ -0,0 +1,504 @@
+#pragma once
+#ifndef DistributedAudio_H
+#define DistributedAudio_H
+
+/*
+Distributed audio rendering.
+
+Only the node with the audio device (CAP_AUDIO_IO) runs onSound, so every
+voice has to fit on that machine's CPU. With these classes the voices are
+spread over the cluster instead:
+
+- the audio node runs a DistributedAudioMixer. Its block counter is the
+  shared sample clock, which is broadcast to every render node.
+- every other node runs a DistributedAudioRenderer, which renders its share
+  of the voices block by block on its own thread, up to `latency` blocks
+  ahead of the clock, and sends the blocks back.
+- the mixer adds the block with the same number from every node to its own
+  output, so all nodes stay sample aligned.
+
+Each node is given an index and the node count (the audio node is node 0),
+so deciding which node plays a voice only needs something all nodes agree
+on, e.g. owns(voiceId, block). Because remote blocks are rendered ahead of
+time, events must be known `latency` blocks before they sound, e.g. come
+from a score or the shared clock itself. The added latency is fixed: a
+block that is not complete when it is due is left out (and counted as
+missing), never waited for.
+
+When nodes join or leave, the mixer numbers the nodes again from 0 to
+count - 1. Renderers have already decided ownership for the next `latency`
+blocks, so the new numbering only starts at a block none of them has
+rendered yet; the clock announces that block along with both numberings,
+and every node switches there. A voice is owned by the numbering of the
+block it starts in, so no voice is played twice or by nobody. The share of
+a node that left is silent until the switch.
+
+Blocks are sent as float samples split into datagrams, so a render node
+costs about channels * sampleRate * 4 bytes/s of bandwidth.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "UdpSocket.hpp"
+
+struct DistributedAudioHeader {
+  enum Type : uint32_t { HELLO = 1, CLOCK, BLOCK };
+
+  uint32_t magic = MAGIC;
+  uint32_t type;
+  uint32_t block;    // CLOCK: current block of the audio node
+  uint16_t node;     // id of the receiving (CLOCK) or sending (BLOCK) node
+  uint16_t nodes;    // CLOCK: number of nodes, including the audio node
+  uint16_t frames;   // frames per block
+  uint16_t channels;
+  uint16_t channel;  // BLOCK: channel and first frame of the samples that
+  uint16_t offset;   // follow the header
+  uint32_t latency;  // CLOCK: blocks a node may render ahead
+  float sampleRate;  // CLOCK
+
+  // CLOCK: the node numbering. Before block `switchBlock` there are `nodes`
+  // nodes and the receiving node has index `rank`, from then on `nextNodes`
+  // and `nextRank`. A rank is NONE for a node that plays no voices.
+  // `membership` counts the changes of numbering.
+  uint32_t switchBlock;
+  uint32_t membership;
+  uint16_t rank;
+  uint16_t nextNodes;
+  uint16_t nextRank;
+
+  static constexpr uint32_t MAGIC = 0x4144414C;  // "LADA"
+  static constexpr uint16_t NONE = 0xFFFF;
+
+  // samples that fit in one datagram after the header
+  static constexpr size_t maxSamples() {
+    return (UdpSocket::safePayload() - sizeof(DistributedAudioHeader)) /
+           sizeof(float);
+  }
+};
+
+// Runs on the audio node
+class DistributedAudioMixer {
+public:
+  ~DistributedAudioMixer() { stop(); }
+
+  // Call before audio starts, with the audio device configuration.
+  // latency is in blocks; it must cover the network round trip and the
+  // render nodes' scheduling jitter.
+  bool start(int framesPerBuffer, int channels, float sampleRate,
+             uint16_t port = 10400, int latency = 4, int maxNodes = 16) {
+    mFrames = framesPerBuffer;
+    mChannels = channels;
+    mSampleRate = sampleRate;
+    mLatency = std::max(1, latency);
+    int ring = mLatency + 2;  // a slot is never refilled while it is due
+    mNodes.clear();
+    for (int i = 0; i < maxNodes; i++) {
+      mNodes.emplace_back(new Node);
+      mNodes.back()->slots.reset(new Slot[ring]);
+      mNodes.back()->slotCount = ring;
+      for (int s = 0; s < ring; s++) {
+        mNodes.back()->slots[s].samples.resize(mFrames * mChannels);
+      }
+    }
+    if (!mSocket.open(port)) return false;
+    mRunning = true;
+    mThread = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    if (mRunning.exchange(false)) mThread.join();
+    mSocket.close();
+  }
+
+  // Number of the block about to be rendered. Block b starts at sample
+  // b * framesPerBuffer of the shared clock.
+  uint32_t block() const { return mBlock.load(std::memory_order_relaxed); }
+
+  // Node count including this one at the current block, and the number of
+  // changes so far
+  int nodes() const { return nodes(block()); }
+  uint32_t membership() const { return mMembership.load(); }
+
+  // Whether this node (always index 0) plays the voice starting in block
+  bool owns(uint64_t voiceId, uint32_t block) const {
+    return voiceId % nodes(block) == 0;
+  }
+
+  // Call from onSound after rendering the local voices. Adds the remote
+  // blocks for the current block and advances the clock. Lock and
+  // allocation free.
+  void mix(al::AudioIOData& io) {
+    uint32_t b = mBlock.load(std::memory_order_relaxed);
+    int channels = std::min(mChannels, (int)io.channelsOut());
+    int frames = std::min(mFrames, (int)io.framesPerBuffer());
+    for (auto& node : mNodes) {
+      if (!node->active.load(std::memory_order_acquire)) continue;
+      Slot& slot = node->slots[b % node->slotCount];
+      if (slot.block.load(std::memory_order_acquire) != b ||
+          slot.received.load(std::memory_order_acquire) !=
+              mFrames * mChannels) {
+        node->missing++;
+        continue;
+      }
+      for (int c = 0; c < channels; c++) {
+        float* out = io.outBuffer(c);
+        const float* in = slot.samples.data() + c * mFrames;
+        for (int i = 0; i < frames; i++) out[i] += in[i];
+      }
+    }
+    mBlock.store(b + 1, std::memory_order_release);
+  }
+
+  // Blocks that were not complete when they were due, for all nodes
+  uint64_t missingBlocks() const {
+    uint64_t n = 0;
+    for (auto& node : mNodes) n += node->missing.load();
+    return n;
+  }
+
+  // Nodes that are rendering, not counting this one
+  int remoteNodes() const {
+    int n = 0;
+    for (auto& node : mNodes) n += node->active.load() ? 1 : 0;
+    return n;
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> block{~0u};
+    std::atomic<int> received{0};
+    std::vector<float> samples;  // channel after channel
+  };
+
+  struct Node {
+    std::atomic<bool> active{false};
+    std::atomic<uint64_t> missing{0};
+    sockaddr_in addr;
+    double lastSeen = 0;
+    int rank = -1, nextRank = -1;  // -1 if the node plays no voices
+    std::unique_ptr<Slot[]> slots;
+    int slotCount = 0;
+  };
+
+  static double now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  void run() {
+    std::vector<uint8_t> buffer(65536);
+    uint32_t lastClock = ~0u;
+    while (mRunning) {
+      mSocket.wait(0.001);
+      double t = now();
+      int size;
+      while ((size = mSocket.receive(buffer.data(), buffer.size())) >=
+             int(sizeof(DistributedAudioHeader))) {
+        DistributedAudioHeader h;
+        std::memcpy(&h, buffer.data(), sizeof(h));
+        if (h.magic != DistributedAudioHeader::MAGIC) continue;
+        if (h.type == DistributedAudioHeader::HELLO) {
+          hello(t);
+        } else if (h.type == DistributedAudioHeader::BLOCK) {
+          receiveBlock(h, (const float*)(buffer.data() + sizeof(h)),
+                       (size - sizeof(h)) / sizeof(float), t);
+        }
+      }
+
+      // forget nodes that went silent
+      for (auto& node : mNodes) {
+        if (node->active && t - node->lastSeen > 1.0) node->active = false;
+      }
+      updateNumbering();
+
+      uint32_t clock = mBlock.load(std::memory_order_acquire);
+      if (clock != lastClock) {
+        lastClock = clock;
+        sendClock(clock);
+      }
+    }
+  }
+
+  // Node counts before and after the switch block, and the switch block,
+  // packed so the audio thread reads them at once
+  static uint64_t numbering(int nodes, int nextNodes, uint32_t switchBlock) {
+    return uint64_t(nodes) << 48 | uint64_t(nextNodes) << 32 | switchBlock;
+  }
+
+  int nodes(uint32_t block) const {
+    uint64_t n = mNumbering.load(std::memory_order_acquire);
+    bool switched = int32_t(block - uint32_t(n)) >= 0;
+    return int((switched ? n >> 32 : n >> 48) & 0xFFFF);
+  }
+
+  // Number the active nodes densely when nodes joined or left. The render
+  // nodes may have rendered up to `latency` blocks past the clock they last
+  // received, so the new numbering starts after that. A change waits until
+  // the previous one has started.
+  void updateNumbering() {
+    uint32_t b = mBlock.load(std::memory_order_acquire);
+    uint64_t n = mNumbering.load(std::memory_order_relaxed);
+    if (int32_t(b - uint32_t(n)) < 0) return;  // not started yet
+    int nextNodes = int(n >> 32 & 0xFFFF);
+    bool changed = false;
+    for (auto& node : mNodes) {
+      node->rank = node->nextRank;
+      changed |= node->active != (node->nextRank >= 0);
+    }
+    if (!changed) {
+      mNumbering.store(numbering(nextNodes, nextNodes, uint32_t(n)),
+                       std::memory_order_release);
+      return;
+    }
+    int count = 1;
+    for (auto& node : mNodes) node->nextRank = node->active ? count++ : -1;
+    mNumbering.store(numbering(nextNodes, count, b + mLatency + 1),
+                     std::memory_order_release);
+    mMembership++;
+  }
+
+  void hello(double t) {
+    const sockaddr_in& from = mSocket.lastSender();
+    Node* free = nullptr;
+    for (auto& node : mNodes) {
+      if (node->active && node->addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+          node->addr.sin_port == from.sin_port) {
+        node->lastSeen = t;
+        return;
+      }
+      // a slot is reused once its node is out of both numberings
+      if (!node->active && node->rank < 0 && node->nextRank < 0 && !free)
+        free = node.get();
+    }
+    if (!free) return;  // too many nodes, or none free yet
+    free->addr = from;
+    free->lastSeen = t;
+    for (int s = 0; s < free->slotCount; s++) free->slots[s].block = ~0u;
+    free->active.store(true, std::memory_order_release);
+  }
+
+  void receiveBlock(const DistributedAudioHeader& h, const float* samples,
+                    size_t count, double t) {
+    if (h.node < 1 || h.node > mNodes.size()) return;
+    Node& node = *mNodes[h.node - 1];
+    if (!node.active) return;
+    node.lastSeen = t;
+    if (h.frames != mFrames || h.channels != mChannels ||
+        h.channel >= mChannels || h.offset + count > size_t(mFrames))
+      return;
+    // too late, or further ahead than allowed
+    uint32_t b = mBlock.load(std::memory_order_acquire);
+    if (int32_t(h.block - b) < 0 || int32_t(h.block - b) > mLatency) return;
+
+    Slot& slot = node.slots[h.block % node.slotCount];
+    if (slot.block.load(std::memory_order_relaxed) != h.block) {
+      // claim the slot for the new block; the audio thread ignores it until
+      // the block is complete
+      slot.block.store(~0u, std::memory_order_relaxed);
+      slot.received.store(0, std::memory_order_relaxed);
+      slot.block.store(h.block, std::memory_order_release);
+    }
+    std::memcpy(slot.samples.data() + h.channel * mFrames + h.offset, samples,
+                count * sizeof(float));
+    slot.received.fetch_add(int(count), std::memory_order_release);
+  }
+
+  void sendClock(uint32_t clock) {
+    DistributedAudioHeader h;
+    h.type = DistributedAudioHeader::CLOCK;
+    h.block = clock;
+    uint64_t n = mNumbering.load(std::memory_order_relaxed);
+    h.nodes = uint16_t(n >> 48);
+    h.nextNodes = uint16_t(n >> 32);
+    h.switchBlock = uint32_t(n);
+    h.membership = mMembership.load();
+    h.frames = uint16_t(mFrames);
+    h.channels = uint16_t(mChannels);
+    h.channel = h.offset = 0;
+    h.latency = uint32_t(mLatency);
+    h.sampleRate = mSampleRate;
+    for (size_t i = 0; i < mNodes.size(); i++) {
+      if (!mNodes[i]->active) continue;
+      h.node = uint16_t(i + 1);
+      h.rank = rank(mNodes[i]->rank);
+      h.nextRank = rank(mNodes[i]->nextRank);
+      mSocket.sendTo(mNodes[i]->addr, &h, sizeof(h));
+    }
+  }
+
+  static uint16_t rank(int r) {
+    return r < 0 ? DistributedAudioHeader::NONE : uint16_t(r);
+  }
+
+  int mFrames = 0, mChannels = 0, mLatency = 4;
+  float mSampleRate = 44100;
+  std::vector<std::unique_ptr<Node>> mNodes;  // remote node i has id i + 1
+  std::atomic<uint32_t> mBlock{0};
+  std::atomic<uint64_t> mNumbering{numbering(1, 1, 0)};
+  std::atomic<uint32_t> mMembership{0};
+
+  UdpSocket mSocket;
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+};
+
+// Runs on each render node
+class DistributedAudioRenderer {
+public:
+  // Called on the render thread for every block this node renders, with io
+  // zeroed and configured like the audio node's output
+  typedef std::function<void(al::AudioIOData& io, uint32_t block)> Callback;
+
+  ~DistributedAudioRenderer() { stop(); }
+
+  bool start(const std::string& audioHost, Callback callback,
+             uint16_t port = 10400) {
+    mCallback = callback;
+    if (!mSocket.open()) return false;
+    if (!mSocket.addDestination(audioHost, port)) return false;
+    mRunning = true;
+    mThread = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    if (mRunning.exchange(false)) mThread.join();
+    mSocket.close();
+  }
+
+  // This node's index and the node count at the latest clock, and the
+  // number of changes of numbering. The index is -1 while this node plays
+  // no voices: until the audio node has answered and a numbering including
+  // this node has started.
+  int node() const { return mNode.load(std::memory_order_relaxed); }
+  int nodes() const { return mNodeCount.load(std::memory_order_relaxed); }
+  uint32_t membership() const { return mMembership.load(); }
+
+  // Whether this node plays the voice starting in block. Call from the
+  // render callback.
+  bool owns(uint64_t voiceId, uint32_t block) const {
+    bool switched = int32_t(block - mClock.switchBlock) >= 0;
+    uint16_t rank = switched ? mClock.nextRank : mClock.rank;
+    uint16_t nodes = switched ? mClock.nextNodes : mClock.nodes;
+    return rank != DistributedAudioHeader::NONE && voiceId % nodes == rank;
+  }
+
+  // Blocks skipped because rendering fell behind the clock
+  uint64_t skippedBlocks() const { return mSkipped.load(); }
+  uint64_t renderedBlocks() const { return mRendered.load(); }
+
+private:
+  void run() {
+    std::vector<uint8_t> packet(UdpSocket::safePayload());
+    DistributedAudioHeader h;
+    double lastHello = 0;
+    bool configured = false;
+    uint32_t next = 0;
+
+    while (mRunning) {
+      double t = now();
+      if (t - lastHello > 0.2) {
+        // introduce ourselves, and keep the audio node from forgetting us
+        h.type = DistributedAudioHeader::HELLO;
+        mSocket.send(&h, sizeof(h));
+        lastHello = t;
+      }
+
+      mSocket.wait(0.005);
+      bool clocked = false;
+      while (mSocket.receive(packet.data(), packet.size()) >=
+             int(sizeof(DistributedAudioHeader))) {
+        std::memcpy(&h, packet.data(), sizeof(h));
+        if (h.magic != DistributedAudioHeader::MAGIC ||
+            h.type != DistributedAudioHeader::CLOCK)
+          continue;
+        if (!clocked || int32_t(h.block - mClock.block) > 0) mClock = h;
+        clocked = true;
+      }
+      if (!clocked) continue;
+
+      if (!configured || mIO.framesPerBuffer() != mClock.frames ||
+          mIO.channelsOut() != mClock.channels) {
+        mIO.framesPerSecond(mClock.sampleRate);
+        mIO.framesPerBuffer(mClock.frames);
+        mIO.channelsOut(mClock.channels);
+        next = mClock.block;
+        configured = true;
+      }
+      bool switched = int32_t(mClock.block - mClock.switchBlock) >= 0;
+      uint16_t rank = switched ? mClock.nextRank : mClock.rank;
+      mNode = rank == DistributedAudioHeader::NONE ? -1 : int(rank);
+      mNodeCount = switched ? mClock.nextNodes : mClock.nodes;
+      mMembership = mClock.membership;
+
+      // blocks that are already due can not be delivered in time
+      if (int32_t(next - mClock.block) < 0) {
+        mSkipped += mClock.block - next;
+        next = mClock.block;
+      }
+      while (int32_t(next - mClock.block) <= int32_t(mClock.latency)) {
+        renderBlock(next, packet);
+        next++;
+      }
+    }
+  }
+
+  void renderBlock(uint32_t block, std::vector<uint8_t>& packet) {
+    mIO.zeroOut();
+    mIO.frame(0);
+    mCallback(mIO, block);
+    mIO.frame(0);
+    mRendered++;
+
+    DistributedAudioHeader h;
+    h.type = DistributedAudioHeader::BLOCK;
+    h.block = block;
+    h.node = mClock.node;
+    h.nodes = mClock.nodes;
+    h.frames = mClock.frames;
+    h.channels = mClock.channels;
+    h.latency = 0;
+    h.sampleRate = mClock.sampleRate;
+    const size_t maxSamples = DistributedAudioHeader::maxSamples();
+    for (int c = 0; c < h.channels; c++) {
+      for (size_t offset = 0; offset < h.frames; offset += maxSamples) {
+        size_t count = std::min(maxSamples, h.frames - offset);
+        h.channel = uint16_t(c);
+        h.offset = uint16_t(offset);
+        std::memcpy(packet.data(), &h, sizeof(h));
+        std::memcpy(packet.data() + sizeof(h), mIO.outBuffer(c) + offset,
+                    count * sizeof(float));
+        mSocket.send(packet.data(), sizeof(h) + count * sizeof(float));
+      }
+    }
+  }
+
+  static double now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  Callback mCallback;
+  al::AudioIOData mIO;
+  DistributedAudioHeader mClock;  // latest clock message
+
+  std::atomic<int> mNode{-1}, mNodeCount{0};
+  std::atomic<uint32_t> mMembership{0};
+  std::atomic<uint64_t> mSkipped{0}, mRendered{0};
+
+  UdpSocket mSocket;
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+};
+
+#endif
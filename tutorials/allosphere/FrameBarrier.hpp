@@ -0,0 +1,333 @@
+#pragma once
+#ifndef FrameBarrier_H
+#define FrameBarrier_H
+
+/*
+Frame barrier and latency telemetry for distributed renderers.
+
+State synchronization makes every renderer receive the same state, but not
+at the same time, so on a multi-projector wall neighbouring projectors can
+show different frames. The frame barrier keeps renderers in lockstep:
+
+- the primary announces each frame number (FrameBarrierServer::beginFrame)
+- each renderer, once it has received the state for that frame, sends an
+  acknowledgment and waits (FrameBarrierClient::arrive)
+- when every known renderer has acknowledged the frame, the server tells
+  them all to proceed, so they draw and present the same frame together
+
+A renderer that stops responding only delays the others by the client and
+server timeouts, and is forgotten after a second of silence.
+
+The server measures, for each renderer, the time from announcing a frame to
+receiving its acknowledgment (transport and state delivery latency) and the
+renderer's own frame time, and keeps histograms of both that can be shown
+in a GUI. Timestamps are echoed back to the server, so clocks do not need
+to be synchronized.
+
+The server handles acknowledgments on its own thread so that renderers are
+released as soon as the last one arrives, not at the primary's next frame.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "UdpSocket.hpp"
+
+struct FrameBarrierMessage {
+  enum Type : uint32_t { FRAME = 1, ACK, PROCEED };
+
+  uint32_t magic = MAGIC;
+  uint32_t type;
+  uint32_t frame;
+  uint32_t padding = 0;
+  double time;       // server clock, echoed back by clients
+  double frameTime;  // ACK: client's last frame duration in seconds
+
+  static constexpr uint32_t MAGIC = 0x42464C41;  // "ALFB"
+
+  static double now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+};
+
+// Histogram with fixed width bins. Values past the last bin are counted in
+// the last bin.
+class LatencyHistogram {
+public:
+  explicit LatencyHistogram(int bins = 64, double binWidth = 0.0005)
+      : mCounts(bins, 0.0f), mBinWidth(binWidth) {}
+
+  void add(double value) {
+    int bin = int(value / mBinWidth);
+    bin = std::max(0, std::min(bin, int(mCounts.size()) - 1));
+    mCounts[bin] += 1.0f;
+    mCount++;
+    double delta = value - mMean;
+    mMean += delta / mCount;
+    mM2 += delta * (value - mMean);
+    mMax = std::max(mMax, value);
+  }
+
+  void clear() {
+    std::fill(mCounts.begin(), mCounts.end(), 0.0f);
+    mCount = 0;
+    mMean = mM2 = mMax = 0;
+  }
+
+  // counts per bin, as floats for ImGui::PlotHistogram
+  const std::vector<float>& counts() const { return mCounts; }
+  double binWidth() const { return mBinWidth; }
+  uint64_t count() const { return mCount; }
+  double mean() const { return mMean; }
+  // standard deviation
+  double jitter() const { return mCount > 1 ? std::sqrt(mM2 / (mCount - 1)) : 0; }
+  double max() const { return mMax; }
+
+private:
+  std::vector<float> mCounts;
+  double mBinWidth;
+  uint64_t mCount = 0;
+  double mMean = 0, mM2 = 0, mMax = 0;
+};
+
+// Runs on the primary
+class FrameBarrierServer {
+public:
+  struct NodeStats {
+    std::string name;  // address:port
+    LatencyHistogram latency;
+    LatencyHistogram frameTime;
+    uint32_t lastFrame = 0;
+    uint64_t late = 0;  // acks that arrived after the frame was released
+  };
+
+  ~FrameBarrierServer() { stop(); }
+
+  bool start(uint16_t port = 10300) {
+    if (!mSocket.open(port)) return false;
+    mRunning = true;
+    mThread = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    if (mRunning.exchange(false)) mThread.join();
+    mSocket.close();
+  }
+
+  // Announce a frame. Call when the state for this frame is produced.
+  void beginFrame(uint32_t frame) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFrame = frame;
+    mFrameStart = FrameBarrierMessage::now();
+    mReleased = false;
+    for (auto& n : mNodes) n.second.acked = false;
+    FrameBarrierMessage m;
+    m.type = FrameBarrierMessage::FRAME;
+    m.frame = frame;
+    m.time = mFrameStart;
+    m.frameTime = 0;
+    for (auto& n : mNodes) mSocket.sendTo(n.second.addr, &m, sizeof(m));
+    if (mNodes.empty()) mReleased = true;
+  }
+
+  // Copy of the statistics of every node, for display
+  std::vector<NodeStats> stats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<NodeStats> s;
+    for (auto& n : mNodes) s.push_back(n.second.stats);
+    return s;
+  }
+
+  // Time from announcing a frame to releasing it, i.e. the slowest node
+  LatencyHistogram barrierTime() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBarrierTime;
+  }
+
+  void clearStats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& n : mNodes) {
+      n.second.stats.latency.clear();
+      n.second.stats.frameTime.clear();
+    }
+    mBarrierTime.clear();
+  }
+
+  // Release a frame even if some nodes did not acknowledge it
+  double timeout = 0.05;
+
+private:
+  struct Node {
+    sockaddr_in addr;
+    double lastSeen;
+    bool acked = false;
+    NodeStats stats;
+  };
+
+  static uint64_t key(const sockaddr_in& a) {
+    return (uint64_t(a.sin_addr.s_addr) << 16) | a.sin_port;
+  }
+
+  void run() {
+    FrameBarrierMessage m;
+    while (mRunning) {
+      mSocket.wait(0.01);
+      std::lock_guard<std::mutex> lock(mMutex);
+      double now = FrameBarrierMessage::now();
+      while (mSocket.receive(&m, sizeof(m)) == sizeof(m)) {
+        if (m.magic != FrameBarrierMessage::MAGIC ||
+            m.type != FrameBarrierMessage::ACK)
+          continue;
+        acknowledge(m, now);
+      }
+
+      // forget nodes that went silent
+      for (auto it = mNodes.begin(); it != mNodes.end();) {
+        if (now - it->second.lastSeen > 1.0) {
+          it = mNodes.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      if (!mReleased) {
+        bool all = std::all_of(mNodes.begin(), mNodes.end(),
+                               [](const std::pair<const uint64_t, Node>& n) {
+                                 return n.second.acked;
+                               });
+        if (all || now - mFrameStart > timeout) release(now);
+      }
+    }
+  }
+
+  void acknowledge(const FrameBarrierMessage& m, double now) {
+    const sockaddr_in& from = mSocket.lastSender();
+    auto it = mNodes.find(key(from));
+    if (it == mNodes.end()) {
+      Node n;
+      n.addr = from;
+      char host[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &from.sin_addr, host, sizeof(host));
+      n.stats.name = std::string(host) + ":" + std::to_string(ntohs(from.sin_port));
+      it = mNodes.emplace(key(from), n).first;
+      // a new node only takes part from the next frame on
+      it->second.acked = true;
+    }
+    Node& node = it->second;
+    node.lastSeen = now;
+    if (m.frameTime > 0) node.stats.frameTime.add(m.frameTime);
+    if (m.frame != mFrame) return;  // hello, or an old frame
+    if (m.time > 0) node.stats.latency.add(now - m.time);
+    node.stats.lastFrame = m.frame;
+    if (mReleased) node.stats.late++;
+    node.acked = true;
+  }
+
+  void release(double now) {
+    mReleased = true;
+    mBarrierTime.add(now - mFrameStart);
+    FrameBarrierMessage m;
+    m.type = FrameBarrierMessage::PROCEED;
+    m.frame = mFrame;
+    m.time = now;
+    m.frameTime = 0;
+    for (auto& n : mNodes) mSocket.sendTo(n.second.addr, &m, sizeof(m));
+  }
+
+  UdpSocket mSocket;
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+
+  std::mutex mMutex;  // guards everything below
+  std::map<uint64_t, Node> mNodes;
+  uint32_t mFrame = 0;
+  double mFrameStart = 0;
+  bool mReleased = true;
+  LatencyHistogram mBarrierTime;
+};
+
+// Runs on each renderer
+class FrameBarrierClient {
+public:
+  bool start(const std::string& serverHost, uint16_t port = 10300) {
+    if (!mSocket.open()) return false;
+    if (!mSocket.addDestination(serverHost, port)) return false;
+    // introduce ourselves so the server includes us from the next frame
+    send(0, 0);
+    return true;
+  }
+
+  // Acknowledge that the state for frame has been received and wait until
+  // all renderers have done the same, or timeout. Returns false on timeout.
+  bool arrive(uint32_t frame) {
+    double now = FrameBarrierMessage::now();
+    double frameTime = mLastArrive > 0 ? now - mLastArrive : 0;
+    mLastArrive = now;
+
+    pump();
+    send(frame, frameTime);
+
+    double deadline = now + timeout;
+    while (int32_t(mReleased - frame) < 0) {
+      double left = deadline - FrameBarrierMessage::now();
+      if (left <= 0) {
+        mTimeouts++;
+        return false;
+      }
+      mSocket.wait(left);
+      pump();
+    }
+    return true;
+  }
+
+  uint64_t timeouts() const { return mTimeouts; }
+
+  // Longest time to wait for the other renderers
+  double timeout = 0.05;
+
+private:
+  // Process messages from the server
+  void pump() {
+    FrameBarrierMessage m;
+    while (mSocket.receive(&m, sizeof(m)) == sizeof(m)) {
+      if (m.magic != FrameBarrierMessage::MAGIC) continue;
+      if (m.type == FrameBarrierMessage::FRAME) {
+        mFrameTimes[m.frame % HISTORY] = m.time;
+        mFrameNumbers[m.frame % HISTORY] = m.frame;
+      } else if (m.type == FrameBarrierMessage::PROCEED) {
+        if (int32_t(m.frame - mReleased) > 0) mReleased = m.frame;
+      }
+    }
+  }
+
+  void send(uint32_t frame, double frameTime) {
+    FrameBarrierMessage m;
+    m.type = FrameBarrierMessage::ACK;
+    m.frame = frame;
+    // echo the server's timestamp for this frame if it was announced
+    m.time = mFrameNumbers[frame % HISTORY] == frame ? mFrameTimes[frame % HISTORY]
+                                                   : 0;
+    m.frameTime = frameTime;
+    mSocket.send(&m, sizeof(m));
+  }
+
+  static const int HISTORY = 16;
+
+  UdpSocket mSocket;
+  double mFrameTimes[HISTORY] = {};
+  uint32_t mFrameNumbers[HISTORY] = {};
+  uint32_t mReleased = 0;
+  double mLastArrive = 0;
+  uint64_t mTimeouts = 0;
+};
+
+#endif
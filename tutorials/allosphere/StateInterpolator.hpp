@@ -0,0 +1,201 @@
+#pragma once
+#ifndef StateInterpolator_H
+#define StateInterpolator_H
+
+/*
+Renderer side interpolation of timestamped states.
+
+Renderers that apply the received state directly (nav() = state().nav)
+show any jitter in the arrival of states as stutter, and can not draw more
+different frames than the primary simulates. StateInterpolator keeps the
+last few states received, each stamped by the primary with its simulation
+time, and reconstructs the state at display rate:
+
+- the renderer's clock is mapped to the primary's clock using the fastest
+  observed delivery, so the two machines do not need synchronized clocks
+- the state is displayed a little in the past (about one state interval
+  plus the observed jitter) and interpolated between the two received
+  states around that time
+- if no newer state has arrived yet, the registered fields are dead
+  reckoned (extrapolated) from the last two states for up to
+  maxExtrapolation seconds
+
+Only the fields registered with field() are interpolated; the others take
+their value from the older of the two states. Arithmetic types, al::Vec,
+al::Quat (slerp) and al::Pose/al::Nav (position and orientation) are
+supported.
+
+  StateInterpolator<CommonState> interp;
+  interp.field(&CommonState::nav);
+  interp.field(&CommonState::mod);
+  ...
+  interp.push(state().time, state());  // renderer, on every frame
+  CommonState s;
+  if (interp.sample(s)) nav() = s.nav;
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "al/math/al_Quat.hpp"
+#include "al/math/al_Vec.hpp"
+#include "al/spatial/al_Pose.hpp"
+
+namespace state_blend {
+
+template <class T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type blend(
+    T& out, const T& a, const T& b, double t) {
+  out = T(a + (b - a) * t);
+}
+
+template <int N, class T>
+void blend(al::Vec<N, T>& out, const al::Vec<N, T>& a, const al::Vec<N, T>& b,
+           double t) {
+  for (int i = 0; i < N; i++) blend(out[i], a[i], b[i], t);
+}
+
+// rotations are not extrapolated, they hold at the newest value
+template <class T>
+void blend(al::Quat<T>& out, const al::Quat<T>& a, const al::Quat<T>& b,
+           double t) {
+  out = al::Quat<T>::slerp(a, b, T(std::min(t, 1.0)));
+}
+
+// also used for al::Nav, which is a Pose
+inline void blend(al::Pose& out, const al::Pose& a, const al::Pose& b,
+                  double t) {
+  al::Vec3d pos;
+  blend(pos, a.pos(), b.pos(), t);
+  al::Quatd quat;
+  blend(quat, a.quat(), b.quat(), t);
+  out.pos(pos);
+  out.quat(quat);
+}
+
+}  // namespace state_blend
+
+template <class State>
+class StateInterpolator {
+public:
+  explicit StateInterpolator(size_t capacity = 8)
+      : mCapacity(std::max<size_t>(capacity, 2)) {}
+
+  // Interpolate this member of State
+  template <class T>
+  void field(T State::*member) {
+    mBlenders.push_back([member](State& out, const State& a, const State& b,
+                                 double t) {
+      state_blend::blend(out.*member, a.*member, b.*member, t);
+    });
+  }
+
+  // Record a state stamped with the primary's time in seconds. States that
+  // are not newer than the last one recorded are ignored, so this can be
+  // called on every frame.
+  void push(double time, const State& state) {
+    if (!mSnapshots.empty()) {
+      // the primary restarted, its clock starts over
+      if (time < mSnapshots.back().time - 1.0) clear();
+      else if (time <= mSnapshots.back().time) return;
+    }
+
+    double now = localTime();
+    // arrival - send time: transport delay plus clock offset. The smallest
+    // recent value is the least delayed state
+    double offset = now - time;
+    mOffsets.push_back(offset);
+    if (mOffsets.size() > 64) mOffsets.erase(mOffsets.begin());
+    mOffset = *std::min_element(mOffsets.begin(), mOffsets.end());
+    mJitter += 0.1 * ((offset - mOffset) - mJitter);
+
+    if (!mSnapshots.empty()) {
+      double interval = time - mSnapshots.back().time;
+      mInterval = mInterval > 0 ? mInterval + 0.1 * (interval - mInterval)
+                                : interval;
+    }
+
+    if (mSnapshots.size() == mCapacity) mSnapshots.erase(mSnapshots.begin());
+    mSnapshots.push_back({time, state});
+  }
+
+  // Reconstruct the state for the current display time. Returns false if no
+  // state has been received yet.
+  bool sample(State& out) {
+    if (mSnapshots.empty()) return false;
+    if (mSnapshots.size() == 1) {
+      out = mSnapshots.back().state;
+      return true;
+    }
+
+    double t = localTime() - mOffset - renderDelay();
+    mDisplayTime = t;
+
+    // the states around t, or the last two to extrapolate
+    size_t i = 1;
+    while (i + 1 < mSnapshots.size() && mSnapshots[i].time < t) i++;
+    const Snapshot& a = mSnapshots[i - 1];
+    const Snapshot& b = mSnapshots[i];
+
+    double amount = (t - a.time) / (b.time - a.time);
+    double limit = 1.0 + maxExtrapolation / (b.time - a.time);
+    amount = std::max(0.0, std::min(amount, limit));
+    mExtrapolating = amount > 1.0;
+
+    out = a.state;
+    for (auto& blender : mBlenders) blender(out, a.state, b.state, amount);
+    return true;
+  }
+
+  // How far behind the primary the display runs, in seconds. Uses delay if
+  // set (>= 0), otherwise one state interval plus twice the jitter.
+  double renderDelay() const {
+    return delay >= 0 ? delay : mInterval + 2.0 * mJitter;
+  }
+
+  // Average time between states sent by the primary, in seconds
+  double stateInterval() const { return mInterval; }
+  double jitter() const { return mJitter; }
+  // Primary time the last sample() displayed
+  double displayTime() const { return mDisplayTime; }
+  // true if the last sample() had to extrapolate
+  bool extrapolating() const { return mExtrapolating; }
+
+  void clear() {
+    mSnapshots.clear();
+    mOffsets.clear();
+    mInterval = 0;
+    mJitter = 0;
+  }
+
+  double delay = -1;              // seconds, < 0 for automatic
+  double maxExtrapolation = 0.1;  // seconds
+
+private:
+  struct Snapshot {
+    double time;
+    State state;
+  };
+
+  static double localTime() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  size_t mCapacity;
+  std::vector<Snapshot> mSnapshots;  // oldest first
+  std::vector<double> mOffsets;
+  std::vector<std::function<void(State&, const State&, const State&, double)>>
+      mBlenders;
+  double mOffset = 0;
+  double mInterval = 0;
+  double mJitter = 0;
+  double mDisplayTime = 0;
+  bool mExtrapolating = false;
+};
+
+#endif
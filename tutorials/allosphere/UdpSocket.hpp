@@ -0,0 +1,183 @@
+#pragma once
+#ifndef UdpSocket_H
+#define UdpSocket_H
+
+/*
+Minimal non-blocking UDP socket used by the distributed tutorials to move
+raw datagrams between nodes (state deltas, frame acks, audio blocks).
+
+Like cuttlebone, this relies on POSIX sockets and is not available on
+Windows.
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class UdpSocket {
+public:
+  UdpSocket() = default;
+  ~UdpSocket() { close(); }
+  UdpSocket(const UdpSocket&) = delete;
+  UdpSocket& operator=(const UdpSocket&) = delete;
+
+  // Open a socket. If port is not 0 the socket is bound to it on all
+  // interfaces so it can receive. bufferSize asks for kernel send and
+  // receive buffers that hold a whole frame of datagrams. The system may
+  // grant less (on Linux, net.core.rmem_max and wmem_max, about 200 KB by
+  // default); the sizes granted are in receiveBufferSize() and
+  // sendBufferSize(), and a warning is printed once when they are smaller.
+  bool open(uint16_t port = 0, int bufferSize = 8 << 20) {
+    close();
+    mFd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (mFd < 0) return false;
+
+    int one = 1;
+    setsockopt(mFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(mFd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+    setsockopt(mFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(mFd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    mReceiveBufferSize = granted(SO_RCVBUF);
+    mSendBufferSize = granted(SO_SNDBUF);
+    static bool warned = false;
+    if ((mReceiveBufferSize < bufferSize || mSendBufferSize < bufferSize) &&
+        !warned) {
+      warned = true;
+      std::cerr << "UdpSocket: asked for " << bufferSize
+                << " byte socket buffers, got " << mReceiveBufferSize
+                << " (receive) and " << mSendBufferSize
+                << " (send). Datagrams may be dropped; raise "
+                   "net.core.rmem_max and net.core.wmem_max."
+                << std::endl;
+    }
+    fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL, 0) | O_NONBLOCK);
+
+    if (port != 0) {
+      sockaddr_in addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(port);
+      if (::bind(mFd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void close() {
+    if (mFd >= 0) ::close(mFd);
+    mFd = -1;
+  }
+
+  bool opened() const { return mFd >= 0; }
+
+  // Kernel buffer sizes granted by open(), as reported by the system
+  int receiveBufferSize() const { return mReceiveBufferSize; }
+  int sendBufferSize() const { return mSendBufferSize; }
+
+  // Add a destination for send()
+  bool addDestination(const std::string& host, uint16_t port) {
+    sockaddr_in addr;
+    if (!resolve(host, port, addr)) return false;
+    mDestinations.push_back(addr);
+    return true;
+  }
+
+  void clearDestinations() { mDestinations.clear(); }
+
+  // Send a datagram to every destination. Returns false if any send failed.
+  bool send(const void* data, size_t size) {
+    bool ok = true;
+    for (const sockaddr_in& addr : mDestinations) {
+      ok &= ::sendto(mFd, data, size, 0, (const sockaddr*)&addr,
+                     sizeof(addr)) == ssize_t(size);
+    }
+    return ok;
+  }
+
+  // Send a datagram to the sender of the last received datagram
+  bool reply(const void* data, size_t size) {
+    return ::sendto(mFd, data, size, 0, (const sockaddr*)&mLastSender,
+                    sizeof(mLastSender)) == ssize_t(size);
+  }
+
+  // Send a datagram to an address, e.g. one returned by lastSender()
+  bool sendTo(const sockaddr_in& addr, const void* data, size_t size) {
+    return ::sendto(mFd, data, size, 0, (const sockaddr*)&addr,
+                    sizeof(addr)) == ssize_t(size);
+  }
+
+  // Address of the sender of the last received datagram
+  const sockaddr_in& lastSender() const { return mLastSender; }
+
+  // Block until a datagram is available or timeout seconds have passed.
+  // Returns true if a datagram is available.
+  bool wait(double timeout) {
+    pollfd p;
+    p.fd = mFd;
+    p.events = POLLIN;
+    p.revents = 0;
+    return ::poll(&p, 1, int(timeout * 1000.0 + 0.5)) > 0;
+  }
+
+  // Receive one datagram if available. Returns its size, or -1 if none is
+  // waiting.
+  int receive(void* buffer, size_t capacity) {
+    socklen_t len = sizeof(mLastSender);
+    ssize_t n = ::recvfrom(mFd, buffer, capacity, 0, (sockaddr*)&mLastSender,
+                           &len);
+    return n < 0 ? -1 : int(n);
+  }
+
+  // Largest payload that fits in a single Ethernet frame without IP
+  // fragmentation
+  static constexpr size_t safePayload() { return 1472; }
+
+private:
+  int granted(int option) const {
+    int size = 0;
+    socklen_t len = sizeof(size);
+    getsockopt(mFd, SOL_SOCKET, option, &size, &len);
+#ifdef __linux__
+    size /= 2;  // Linux reports twice the size, counting its bookkeeping
+#endif
+    return size;
+  }
+
+  static bool resolve(const std::string& host, uint16_t port,
+                      sockaddr_in& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1) return true;
+
+    addrinfo hints, *result = nullptr;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result)
+      return false;
+    addr.sin_addr = ((sockaddr_in*)result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return true;
+  }
+
+  int mFd = -1;
+  int mReceiveBufferSize = 0, mSendBufferSize = 0;
+  std::vector<sockaddr_in> mDestinations;
+  sockaddr_in mLastSender{};
+};
+
+#endif
@@ -1,31 +1,70 @@
 
 
+#include <atomic>
+#include <cstdio>
+
 #include "al/app/al_App.hpp"
 #include "al/math/al_Random.hpp"
 #include "al/ui/al_ParameterGUI.hpp"
-#include "al/ui/al_ParameterMIDI.hpp"
+
+#include "../synthesis/MidiQueue.hpp"
 
 using namespace al;
 
 // This example shows the connection between a MIDI controller and the gain
-// parameter in the App, together with a GUI to set up MIDI device
+// parameter in the App, together with a GUI to show it
+//
+// MIDI messages arrive on RtMidi's thread. Instead of setting the parameter
+// from there, and having the change land at the start of whatever block is
+// next, messages are timestamped and queued, and the audio callback applies
+// them at the sample they belong to.
+//
+// The audio thread does not set the parameter either, as that would run its
+// callbacks and listeners there. It publishes the controller's value, and
+// onAnimate copies it to the parameter.
 
-struct MyApp : public App {
+struct MyApp : public App, MIDIMessageHandler {
   Parameter gain{"gain", "", 0.2f, 0.0, 1.0};
-  ParameterMIDI parameterMIDI;
+  RtMidiIn midiIn;
+  MidiQueue midiQueue;
+
+  // Gain as the audio thread applies it, changed by the GUI and by the
+  // controller
+  float audioGain = 0.2f;
+  float lastGuiGain = 0.2f;
+  std::atomic<float> guiGain{0.2f};         // set from the GUI
+  std::atomic<float> controllerGain{0.2f};  // set by the audio thread
+  std::atomic<bool> controllerMoved{false};
 
   rnd::Random<> random;
 
   void onCreate() override {
     imguiInit();
-    parameterMIDI.connectControl(gain, 1, 1);
+    gain.registerChangeCallback([this](float value) { guiGain = value; });
+    if (midiIn.getPortCount() > 0) {
+      MIDIMessageHandler::bindTo(midiIn);
+      // Open the last device found
+      unsigned int port = midiIn.getPortCount() - 1;
+      midiIn.openPort(port);
+      printf("Opened port to %s\n", midiIn.getPortName(port).c_str());
+    } else {
+      printf("No MIDI devices found.\n");
+    }
   }
 
+  // RtMidi's thread
+  void onMIDIMessage(const MIDIMessage &m) override { midiQueue.push(m); }
+
   void onAnimate(double dt) override {
+    // Show the controller's value. setNoCalls(), so the change does not come
+    // back to the audio thread as a GUI change.
+    if (controllerMoved.exchange(false)) {
+      gain.setNoCalls(controllerGain.load());
+    }
     imguiBeginFrame();
     ParameterGUI::beginPanel("MIDI");
     ParameterGUI::draw(&gain);
-    ParameterGUI::drawParameterMIDI(&parameterMIDI);
+    ImGui::Text("Controller 1 on channel 1 sets the gain");
     ParameterGUI::endPanel();
     imguiEndFrame();
   }
@@ -36,8 +75,23 @@ struct MyApp : public App {
   }
 
   void onSound(AudioIOData &io) override {
+    float g = guiGain.load();
+    if (g != lastGuiGain) {
+      lastGuiGain = g;
+      audioGain = g;
+    }
+    midiQueue.beginBlock(io);
     while (io()) {
-      io.out(0) = random.uniform() * gain;
+      MIDIMessage m(0, 0, 0);
+      while (midiQueue.next(io.frame(), m)) {
+        if (m.type() == MIDIByte::CONTROL_CHANGE && m.channel() == 0 &&
+            m.controlNumber() == 1) {
+          audioGain = m.controlValue();
+          controllerGain = audioGain;
+          controllerMoved = true;
+        }
+      }
+      io.out(0) = random.uniform() * audioGain;
     }
   }
 
@@ -30,6 +30,8 @@ public:
     */
     presetHandler << X << Y << Size;
     presetHandler.setMorphTime(2.0); // Presets will take 2 seconds to "morph"
+    // The morph steps the parameters from a control thread, which is fine for
+    // graphics. For parameters used in audio see 14_preset_morph.cpp.
 
     /*
         You need to register the PresetHandler object into the PresetServer
@@ -137,6 +139,9 @@ private:
       gradually "morphed" (i.e. interpolated linearly) until they reach their
       destination. The time of this morph is set using the setMorphTime()
       function.
+
+      Each preset is a text file that is read on recall. For large numbers of
+      presets see the binary preset banks in 15_preset_bank.cpp.
   */
   PresetHandler presetHandler{"sequencerPresets"};
   /*
@@ -21,6 +21,11 @@ using namespace al;
  *
  * Events can be sequenced programatically (i.e. directly in C++ code) or in
  * realtime. This tutorial shows the first mechanism.
+ *
+ * Pieces that schedule thousands of events while running, from the GUI or
+ * another thread, can use VoiceScheduler from synthesis/TimingWheel.hpp
+ * instead: adding and triggering events there costs the same no matter how
+ * many are pending. See fillTime() in synthesis/10_Integrated.cpp.
  */
 
 /*
@@ -1,21 +1,31 @@
 
+#include <ctime>
+#include <string>
+
 #include "Gamma/Domain.h"
 #include "Gamma/Envelope.h"
 #include "Gamma/Oscillator.h"
 #include "al/app/al_App.hpp"
 #include "al/graphics/al_Shapes.hpp"
-#include "al/scene/al_SynthRecorder.hpp"
 #include "al/scene/al_SynthSequencer.hpp"
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 #include "al/ui/al_PresetSequencer.hpp"
 
+#include "AsyncSynthRecorder.hpp"
+#include "ParameterBatch.hpp"
+
 using namespace al;
 
 /*
- * This tutorial shows how to use the SynthRecorder class
+ * This tutorial shows how to record a PolySynth to a text file and play it
+ * back with the SynthSequencer class
  *
- * This class allows recording and playback of a PolySynth to a text file.
+ * Recording uses AsyncSynthRecorder (AsyncSynthRecorder.hpp). Like
+ * SynthRecorder it records the trigger events of a PolySynth, but the
+ * triggering thread only copies each event into a lock-free ring, and a
+ * background thread writes them to the file, so recording a long
+ * performance costs the GUI and audio threads no formatting or I/O.
  * To allow the SynthVoice to read and write you must implement the
  * setParamFields and getParamFields function and register the SynthVoice to
  * allow instantiation from a text file.
@@ -65,13 +75,17 @@ public:
     // necessary to use a Parameter here in order to simplify the sequencing, as
     // if parameters are used, the sequence recording and playback is automatic
     // after registering the paramters as "fields"
-    mFrequency.registerChangeCallback(
-        [this](float value) { mSource.freq(value); });
+    //
+    // The parameters are set from the GUI, or when a sequence plays, but the
+    // oscillator and envelope belong to the audio thread. The batch collects
+    // the changes and applies the latest of each at the start of the next
+    // audio block (see onProcess()).
+    mChanges.add(mFrequency, [this](float value) { mSource.freq(value); });
     // We need to do the same fo the attack and the release
-    mAttack.registerChangeCallback(
-        [this](float value) { mEnvelope.lengths()[0] = value; });
-    mRelease.registerChangeCallback(
-        [this](float value) { mEnvelope.lengths()[2] = value; });
+    mChanges.add(mAttack,
+                 [this](float value) { mEnvelope.lengths()[0] = value; });
+    mChanges.add(mRelease,
+                 [this](float value) { mEnvelope.lengths()[2] = value; });
 
     // Register the parameters as fields. This sets the order of the parameters
     // into the fields for sequencing. The order in which the parameters are
@@ -82,6 +96,7 @@ public:
   }
 
   void onProcess(AudioIOData &io) override {
+    mChanges.dispatch(); // Apply parameter changes once per block
     while (io()) {
       io.out(0) += mEnvelope() * mSource() *
                    0.05; // Output on the first channel scaled by 0.05;
@@ -124,6 +139,7 @@ public:
 private:
   gam::Sine<> mSource; // Sine wave oscillator source
   gam::AD<> mEnvelope;
+  ParameterBatch mChanges;
 
   Mesh mesh; // The mesh now belongs to the voice
 
@@ -148,12 +164,18 @@ public:
     gui << X << Y << Size << AttackTime
         << ReleaseTime; // Register the parameters with the GUI
 
-    /*
-     * The SynthRecorder object can be passed to a ControlGUI object to
-     * generate a GUI interface that can be controlled via the mouse
-     */
-
-    gui << mRecorder;
+    // Recording starts and stops with the Record toggle. Each take is
+    // written to a new sequence named after the time it started, where the
+    // sequencer GUI lists them.
+    Record.registerChangeCallback([this](float value) {
+      if (value == 1.0f) {
+        mRecorder.start(takeName() + ".synthSequence");
+      } else {
+        mRecorder.stop();
+      }
+    });
+
+    gui << Record;
     gui << mSequencer;
 
     gui.init(); // Initialize GUI. Don't forget this!
@@ -166,7 +188,7 @@ public:
     // contained within the sequencer accesing it through the synth()
     // function. Using the PolySynth from the sequencer allows both
     // text file based and programmatic (C++ based) sequencing.
-    mRecorder << mSequencer.synth();
+    mRecorder.attach(mSequencer.synth());
   }
 
   void onDraw(Graphics &g) override {
@@ -207,9 +229,18 @@ public:
 
   SynthSequencer &sequencer() { return mSequencer; }
 
-  SynthRecorder &recorder() { return mRecorder; }
+  AsyncSynthRecorder &recorder() { return mRecorder; }
 
 private:
+  // e.g. "take_2024-05-01_14-03-27"
+  static std::string takeName() {
+    std::time_t now = std::time(nullptr);
+    char name[64];
+    std::strftime(name, sizeof(name), "take_%Y-%m-%d_%H-%M-%S",
+                  std::localtime(&now));
+    return name;
+  }
+
   Light light;
 
   Parameter X{"X", "Position", 0.0, -1.0f, 1.0f};
@@ -217,10 +248,11 @@ private:
   Parameter Size{"Scale", "Size", 1.0, 0.1f, 3.0f};
   Parameter AttackTime{"AttackTime", "Sound", 0.1, 0.001f, 2.0f};
   Parameter ReleaseTime{"ReleaseTime", "Sound", 1.0, 0.001f, 5.0f};
+  ParameterBool Record{"Record", "", 0.0};
 
   ControlGUI gui;
 
-  SynthRecorder mRecorder;
+  AsyncSynthRecorder mRecorder;
   SynthSequencer mSequencer;
 };
 
@@ -231,6 +263,7 @@ int main() {
   // the PolySynth (that is inside the sequencer). This allows
   // triggering the class from a text file.
   app.sequencer().synth().registerSynthClass<MyVoice>("MyVoice");
+  app.recorder().synthName<MyVoice>("MyVoice");
 
   app.start();
   return 0;
@@ -19,8 +19,8 @@ using namespace al;
  * voices.
  *
  * This method is adequate for a static array of agents (i.e. not using
- * PolySynth). Hopefully this will be extended in the future to support
- * dynamic chains too.
+ * PolySynth). For thousands of agents, or agents that come and go, see
+ * AgentBundle in 16_agent_bundle.cpp.
  */
 
 #define NUM_VOICES 5
@@ -1,11 +1,17 @@
+#include <cmath>
 #include <string>
+#include <vector>
 
 #include "al/app/al_DistributedApp.hpp"
 #include "al/graphics/al_Font.hpp"
 #include "al/graphics/al_Shapes.hpp"
+#include "al/math/al_Random.hpp"
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "OmniCulling.hpp"
+#include "../synthesis/TextBatch.hpp"
+
 using namespace al;
 
 /* Distributed App provides a simple way to share states and
@@ -15,6 +21,11 @@ using namespace al;
  * This state is synchronous but unreliable information
  * i.e. missed data should not affect the overall state of the
  * application
+ *
+ * Omni rendering draws the scene once per cube map face. The spheres around
+ * the viewer are culled against the face being drawn, faces that the
+ * projectors never see are not drawn at all, and faces seen at low
+ * resolution get a coarser sphere. See OmniCulling.hpp.
  */
 
 struct SharedState {
@@ -33,13 +44,13 @@ public:
     mesh.primitive(Mesh::LINES);
 
     // Register the parameters with the GUI
-    gui << X << Y << Size;
+    gui << X << Y << Size << Culling;
     gui.init(); // Initialize GUI. Don't forget this!
 
     // DistributedApp provides a parameter server.
     // This links the parameters between "simulator" and "renderers"
     // automatically
-    parameterServer() << X << Y << Size;
+    parameterServer() << X << Y << Size << Culling;
 
     //    font.loadDefault(24);
 
@@ -48,6 +59,35 @@ public:
       quit();
     }
     font.alignCenter();
+
+    // Spheres all around the viewer
+    addSphere(sphereFine, 0.3, 24, 24);
+    addSphere(sphereCoarse, 0.3, 8, 8);
+    for (int i = 0; i < 2000; i++) {
+      spheres.push_back(rnd::ball<Vec3f>() * 20.0f);
+    }
+
+    planFaces();
+  }
+
+  // Which faces the projectors see, and at what resolution. Here a single
+  // projector with a 100 degree field of view looks to the front; in the
+  // AlloSphere the directions come from each projector's warp map.
+  void planFaces() {
+    int w = 480, h = 300;
+    float t = std::tan(50 * M_PI / 180), tv = t * h / w;
+    std::vector<float> directions(w * h * 3);
+    for (int j = 0; j < h; j++) {
+      for (int i = 0; i < w; i++) {
+        float *d = &directions[(j * w + i) * 3];
+        d[0] = (2 * (i + 0.5f) / w - 1) * t;
+        d[1] = (2 * (j + 0.5f) / h - 1) * tv;
+        d[2] = -1;
+      }
+    }
+    facePlan.addProjector(directions.data(), w, h);
+    facePlan.compute();
+    std::cout << facePlan.usedFaces() << " cube faces used" << std::endl;
   }
 
   void onAnimate(double /*dt*/) override {
@@ -56,7 +96,14 @@ public:
       navControl().active(!isImguiUsingInput());
     }
 
-    font.write(fontMesh, std::to_string(state().frameCount).c_str(), 1.0f);
+    // Rebuild the label only when the count changes, not for every view.
+    // The count changes every frame, so it is put together from cached
+    // digits instead of laying out new text.
+    if (frameLabel.labels() == 0 || labelFrameCount != state().frameCount) {
+      labelFrameCount = state().frameCount;
+      frameLabel.clear();
+      frameLabel.addNumber(labelFrameCount, 1.0f, 0, 0);
+    }
   }
 
   void onDraw(Graphics &g) override {
@@ -69,19 +116,54 @@ public:
     g.color(1);
     g.draw(mesh); // Draw the mesh
     g.blendAdd();
-    g.texture();
-    font.tex.bind();
-    g.draw(fontMesh);
-    font.tex.unbind();
+    g.tint(1);
+    frameLabel.draw(g);
 
     g.popMatrix();
 
+    drawSpheres(g);
+
     // Draw the GUI on the simulator only
     if (isPrimary()) {
       gui.draw(g);
     }
   }
 
+  void drawSpheres(Graphics &g) {
+    Matrix4f view = g.viewMatrix();
+    Matrix4f proj = g.projMatrix();
+    float viewProj[16];
+    ViewFrustum::multiply(proj.elems(), view.elems(), viewProj);
+    ViewFrustum frustum(viewProj);
+
+    Mesh *sphere = &sphereFine;
+    if (Culling.get()) {
+      // The face being drawn is the one the view looks at, relative to nav
+      Vec3f forward(-view(2, 0), -view(2, 1), -view(2, 2));
+      int face = OmniFacePlan::faceOf(forward.dot(nav().ur()),
+                                      forward.dot(nav().uu()),
+                                      -forward.dot(nav().uf()));
+      if (!facePlan.used(face)) {
+        return; // no projector samples this face
+      }
+      if (facePlan.resolution(face) < 1024) {
+        sphere = &sphereCoarse;
+      }
+    }
+
+    g.color(0.5, 0.7, 1.0);
+    for (auto &pos : spheres) {
+      if (Culling.get() &&
+          !frustum.sphereVisible(pos.x, pos.y, pos.z, 0.3f)) {
+        continue;
+      }
+      g.pushMatrix();
+      g.translate(pos);
+      g.draw(*sphere);
+      g.popMatrix();
+    }
+  }
+
   bool onKeyDown(Keyboard const &k) override {
     if (k.key() == ' ') {
       // The space bar will turn off omni rendering
@@ -97,11 +179,17 @@ public:
 private:
   Mesh mesh;
   Font font;
-  Mesh fontMesh;
+  // A counter never repeats, so keep few layouts
+  TextBatch frameLabel{font, 16};
+  uint16_t labelFrameCount{0};
+  Mesh sphereFine, sphereCoarse;
+  std::vector<Vec3f> spheres;
+  OmniFacePlan facePlan;
 
   Parameter X{"X", "Position", 0.0, -1.0f, 1.0f};
   Parameter Y{"Y", "Position", 0.0, -1.0f, 1.0f};
   Parameter Size{"Scale", "Size", 1.0, 0.1f, 3.0f};
+  ParameterBool Culling{"Culling", "", 1.0};
 
   /* DistributedApp provides a parameter server. In fact it will
    * crash if you have a parameter server with the same port,
@@ -1,4 +1,6 @@
 
+#include <atomic>
+
 #include "Gamma/Domain.h"
 #include "Gamma/Envelope.h"
 #include "Gamma/Oscillator.h"
@@ -17,6 +19,8 @@
 
 //#include "al/util/sound/al_OutputMaster.hpp"
 
+#include "../synthesis/VoiceTelemetry.hpp"
+
 using namespace al;
 
 /*
@@ -34,6 +38,12 @@ using namespace al;
 //#define SpatializerType Dbap
 //#define SpatializerType AmbisonicsSpatializer
 
+// Values the audio thread shares with the graphics thread, once per block
+struct AgentFeatures {
+  float envelope;
+  float modulator;
+};
+
 //
 class MyAgent : public PositionedVoice {
 public:
@@ -45,11 +55,16 @@ public:
   }
 
   void onProcess(AudioIOData &io) override {
+    if (mReleaseRequested.exchange(false)) {
+      mEnvelope.release();
+    }
+    float modulatorValue = 0;
     while (io()) {
-      mModulatorValue = mModulator();
+      modulatorValue = mModulator();
       io.out(0) +=
-          mEnvelope() * mSource() * mModulatorValue * 0.05; // compute sample
+          mEnvelope() * mSource() * modulatorValue * 0.05; // compute sample
     }
+    mTelemetry.publish({mEnvelope.value(), modulatorValue});
 
     if (mEnvelope.done()) {
       free();
@@ -61,12 +76,15 @@ public:
     Mesh *sharedMesh = static_cast<Mesh *>(userData());
     mLifeSpan--;
     if (mLifeSpan == 0) { // If it's time to die, start die off
-      mEnvelope.release();
+      // The envelope belongs to the audio thread, ask it to release
+      mReleaseRequested = true;
     }
+    // Latest values from the audio thread
+    AgentFeatures features = mTelemetry.latest();
     g.pushMatrix();
     gl::polygonMode(GL_LINE);
     g.color(0.1, 0.9, 0.3);
-    g.scale(mSize * mEnvelope.value() + mModulatorValue * 0.1);
+    g.scale(mSize * features.envelope + features.modulator * 0.1);
     g.draw(*sharedMesh); // Draw the mesh
     g.popMatrix();
   }
@@ -86,6 +104,7 @@ public:
     // We want to reset the envelope:
     mEnvelope.reset();
     mModulator.phase(-0.1); // reset the phase
+    mReleaseRequested = false;
   }
 
   // No need for onTriggerOff() function as duration of agent's life is fixed
@@ -97,7 +116,9 @@ public:
   gam::AD<> mEnvelope;
 
   unsigned int mLifeSpan; // life span counter
-  float mModulatorValue;  // To share modulator value from audio to graphics
+  // To share envelope and modulator values from audio to graphics
+  VoiceTelemetry<AgentFeatures> mTelemetry;
+  std::atomic<bool> mReleaseRequested{false};
 };
 
 struct MyApp : public App {
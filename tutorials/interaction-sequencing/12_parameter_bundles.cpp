@@ -0,0 +1,136 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "al/app/al_App.hpp"
+#include "al/graphics/al_Shapes.hpp"
+#include "al/ui/al_ControlGUI.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "ParameterBundler.hpp"
+
+using namespace al;
+
+/* The parameter server (see 02_parameters_OSC.cpp) sends one OSC message
+ * for every change of every parameter. When many parameters change at
+ * once, e.g. while morphing presets, or when a slider is dragged, the
+ * network is flooded with tiny packets.
+ *
+ * ParameterBundleSender sends the same OSC messages, but coalesced: changes
+ * are collected as they happen, only the last value of each parameter is
+ * kept, and once per frame all changed parameters are sent in OSC bundles
+ * that fill a datagram each.
+ *
+ * In this example 2000 parameters change four times per frame. They are sent
+ * to this same application, where a ParameterBundleReceiver applies them to a
+ * second set of parameters with the same OSC addresses (on a cluster the
+ * receiver would be on another machine). The red cone follows the white one
+ * through the network.
+ *
+ * The console shows how many changes were made and how few packets carry
+ * them.
+ */
+
+#define NUM_WAVES 2000
+
+class MyApp : public App {
+public:
+  void onCreate() override {
+    nav().pos(Vec3d(0, 0, 8));
+    addCone(mesh);
+    mesh.primitive(Mesh::LINE_STRIP);
+
+    gui << X << Y << Size;
+    gui.init();
+
+    for (int i = 0; i < NUM_WAVES; i++) {
+      std::string name = "wave" + std::to_string(i);
+      waves.emplace_back(new Parameter(name, "Waves", 0.0));
+      receivedWaves.emplace_back(new Parameter(name, "Waves", 0.0));
+      sender << *waves.back();
+      receiver << *receivedWaves.back();
+    }
+    // Register all parameters before listeners are added
+    sender << X << Y << Size;
+    receiver << receivedX << receivedY << receivedSize;
+
+    receiver.open(9120);
+    sender.addListener("127.0.0.1", 9120);
+  }
+
+  void onAnimate(double dt) override {
+    navControl().active(!gui.usingInput());
+
+    // Several writes per frame: only the last one of each frame is sent
+    for (int k = 0; k < 4; k++) {
+      phase += dt / 4;
+      for (int i = 0; i < NUM_WAVES; i++) {
+        *waves[i] = sin(phase + i * 0.01);
+      }
+    }
+
+    // Send everything that changed during this frame
+    sender.flush();
+    // Apply everything received
+    receiver.poll();
+
+    reportTime += dt;
+    if (reportTime > 1.0) {
+      reportTime = 0;
+      std::cout << sender.changes() << " changes sent as "
+                << sender.messagesSent() << " messages in "
+                << sender.bundlesSent() << " bundles ("
+                << sender.bytesSent() / 1024 << " kB), "
+                << receiver.messagesApplied() << " messages applied"
+                << std::endl;
+    }
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear();
+
+    g.pushMatrix();
+    g.translate(X.get(), Y.get(), 0);
+    g.scale(Size.get());
+    g.draw(mesh);
+    g.popMatrix();
+
+    // Driven by the values received through OSC bundles
+    g.pushMatrix();
+    g.translate(receivedX.get(), receivedY.get() - 0.5, 0);
+    g.scale(receivedSize.get() * (1.0 + 0.2 * receivedWaves[0]->get()));
+    g.color(1, 0, 0);
+    g.draw(mesh);
+    g.popMatrix();
+
+    gui.draw(g);
+  }
+
+private:
+  Mesh mesh;
+  double phase = 0;
+  double reportTime = 0;
+
+  Parameter X{"X", "Position", 0.0, -1.0f, 1.0f};
+  Parameter Y{"Y", "Position", 0.0, -1.0f, 1.0f};
+  Parameter Size{"Scale", "Size", 1.0, 0.1f, 3.0f};
+  std::vector<std::unique_ptr<Parameter>> waves;
+
+  // Same addresses as above, written by the receiver
+  Parameter receivedX{"X", "Position", 0.0, -1.0f, 1.0f};
+  Parameter receivedY{"Y", "Position", 0.0, -1.0f, 1.0f};
+  Parameter receivedSize{"Scale", "Size", 1.0, 0.1f, 3.0f};
+  std::vector<std::unique_ptr<Parameter>> receivedWaves;
+
+  ParameterBundleSender sender;
+  ParameterBundleReceiver receiver;
+
+  ControlGUI gui;
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "Gamma/Domain.h"
+#include "Gamma/Oscillator.h"
+#include "al/app/al_App.hpp"
+#include "al/graphics/al_Shapes.hpp"
+#include "al/math/al_Random.hpp"
+#include "al/scene/al_SynthSequencer.hpp"
+#include "al/ui/al_ControlGUI.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "DrawList.hpp"
+
+using namespace al;
+
+/*
+ * onDraw() can be called several times per frame: once per eye in stereo,
+ * once per window, and once per cube face (six times!) in omni rendering.
+ * In 05_polysynth.cpp every one of those calls walks all the voices and runs
+ * their graphics code again, and the voices even count frames there, so they
+ * would die six times faster in omni rendering.
+ *
+ * Here the synth renders the voices' graphics once per frame, in onAnimate(),
+ * and the voices' onProcess(Graphics &) records what they draw into a
+ * DrawList instead of drawing. onDraw() replays the list, so the scene is
+ * traversed once no matter how many views are rendered.
+ */
+
+// Filled by the voices once per frame, replayed by onDraw()
+DrawList drawList;
+
+class MyVoice : public SynthVoice {
+public:
+  MyVoice() {
+    addCone(mesh);
+    mesh.primitive(Mesh::LINE_STRIP);
+  }
+
+  void onProcess(AudioIOData &io) override {
+    while (io()) {
+      io.out(0) += mSource() * mAmp;
+    }
+  }
+
+  // Called once per frame, from onAnimate(). Records instead of drawing to g.
+  void onProcess(Graphics &g) override {
+    drawList.pushMatrix();
+    drawList.translate(mX, mY, 0);
+    drawList.rotate(mDurCounter * 3.0f, 0, 0, 1);
+    drawList.scale(mSize);
+    drawList.color(1, mDurCounter / 120.0f, 0.5);
+    drawList.draw(mesh);
+    drawList.popMatrix();
+    if (--mDurCounter < 0) {
+      free();
+    }
+  }
+
+  void set(float x, float y, float size, float frequency, float numFrames) {
+    mX = x;
+    mY = y;
+    mSize = size;
+    mSource.freq(frequency);
+    mDurCounter = numFrames;
+  }
+
+  float mAmp{0.002};
+
+private:
+  gam::Sine<> mSource;
+  Mesh mesh;
+  float mX{0}, mY{0}, mSize{1.0};
+  int mDurCounter{0};
+};
+
+class MyApp : public App {
+public:
+  void onCreate() override {
+    nav().pos(Vec3d(0, 0, 8));
+    gui << Size;
+    gui.init();
+    navControl().active(false);
+  }
+
+  void onAnimate(double dt) override {
+    // Traverse the scene once per frame, through the synth's graphics render
+    drawList.clear();
+    mPolySynth.render(graphics());
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear();
+    // Called once per view, only replays the commands
+    drawList.replay(g);
+    gui.draw(g);
+  }
+
+  void onSound(AudioIOData &io) override { mPolySynth.render(io); }
+
+  bool onKeyDown(const Keyboard &k) override {
+    // Every key starts a cloud of voices
+    int midiNote = asciiToMIDI(k.key());
+    if (midiNote <= 0) {
+      return true;
+    }
+    float freq = 440.0f * powf(2, (midiNote - 69) / 12.0f);
+    for (int i = 0; i < 100; i++) {
+      MyVoice *voice = mPolySynth.getVoice<MyVoice>();
+      voice->set(rnd::uniformS() * 3, rnd::uniformS() * 2,
+                 Size * rnd::uniform(0.2, 1.0), freq * (1 + 0.01 * i), 120);
+      mPolySynth.triggerOn(voice);
+    }
+    return true;
+  }
+
+private:
+  Parameter Size{"Scale", "Size", 0.5, 0.1f, 3.0f};
+  ControlGUI gui;
+  PolySynth mPolySynth;
+};
+
+int main() {
+  MyApp app;
+  app.dimensions(800, 600);
+  app.configureAudio(44100, 256, 2, 0);
+  gam::sampleRate(44100);
+  app.start();
+  return 0;
+}
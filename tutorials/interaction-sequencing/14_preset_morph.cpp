@@ -0,0 +1,129 @@
+#include <cmath>
+#include <iostream>
+
+#include "al/app/al_App.hpp"
+#include "al/graphics/al_Shapes.hpp"
+#include "al/math/al_Random.hpp"
+#include "al/ui/al_ControlGUI.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "PresetMorph.hpp"
+
+using namespace al;
+
+/* 03_presets.cpp morphs presets with PresetHandler, which steps the
+ * parameters from a control thread. That is fine for graphics, but a tone
+ * whose frequency follows a stepped parameter zippers.
+ *
+ * Here a PresetMorph drives a pair of detuned sines. Morphs are computed by
+ * the audio thread sample by sample, so they are smooth at any speed.
+ *
+ * Keys:
+ *   alt + 1..4  store the current parameters as preset 1..4
+ *   1..4        morph to the preset in two seconds
+ *   space       randomize the parameters
+ * Drag the mouse to blend the four presets, placed in the corners of the
+ * window, by inverse distance to the mouse.
+ */
+
+class MyApp : public App {
+public:
+  void onCreate() override {
+    nav().pos(Vec3d(0, 0, 8));
+    addCone(mesh);
+    mesh.primitive(Mesh::LINE_STRIP);
+
+    gui << Frequency << Amplitude << Detune;
+    gui.init();
+
+    // Register before audio starts; value(0) is Frequency and so on
+    morph << Frequency << Amplitude << Detune;
+    morph.smoothing(0.05);
+  }
+
+  void onAnimate(double dt) override {
+    navControl().active(!gui.usingInput());
+    // Move the sliders along with the morph
+    morph.updateParameters();
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear();
+    g.pushMatrix();
+    g.translate(Detune * 20, 0, 0);
+    g.scale(Amplitude * 4, Frequency / 440, 1);
+    g.draw(mesh);
+    g.popMatrix();
+    gui.draw(g);
+  }
+
+  void onSound(AudioIOData &io) override {
+    morph.process(io.framesPerBuffer(), io.framesPerSecond());
+    double sr = io.framesPerSecond();
+    while (io()) {
+      // Per sample values, no zipper noise
+      float f = morph.value(0, io.frame());
+      float amp = morph.value(1, io.frame());
+      float detune = morph.value(2, io.frame());
+      phase1 += f / sr;
+      phase2 += f * (1 + detune) / sr;
+      phase1 -= std::floor(phase1);
+      phase2 -= std::floor(phase2);
+      float s = amp * 0.5f *
+                float(std::sin(2 * M_PI * phase1) + std::sin(2 * M_PI * phase2));
+      io.out(0) = s;
+      io.out(1) = s;
+    }
+  }
+
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.isNumber() && k.keyAsNumber() >= 1 && k.keyAsNumber() <= 4) {
+      if (k.alt()) {
+        morph.store(k.keyAsNumber());
+        std::cout << "Storing preset " << k.keyAsNumber() << std::endl;
+      } else if (morph.morphTo(k.keyAsNumber(), 2.0)) {
+        std::cout << "Morphing to preset " << k.keyAsNumber() << std::endl;
+      }
+    } else if (k.key() == ' ') {
+      Frequency = 110 + randomGenerator.uniform() * 770;
+      Amplitude = 0.05 + randomGenerator.uniform() * 0.25;
+      Detune = randomGenerator.uniform() * 0.02;
+    }
+    return true;
+  }
+
+  bool onMouseDrag(const Mouse &m) override {
+    if (gui.usingInput()) {
+      return true;
+    }
+    const int presets[4] = {1, 2, 3, 4};
+    const float x[4] = {0, 1, 0, 1};
+    const float y[4] = {0, 0, 1, 1};
+    float weights[4];
+    PresetMorph::inverseDistanceWeights(x, y, 4, float(m.x()) / width(),
+                                        float(m.y()) / height(), weights);
+    morph.blend(presets, weights, 4, 0.05);
+    return true;
+  }
+
+private:
+  Mesh mesh;
+
+  Parameter Frequency{"Frequency", "Tone", 220, 55, 1760};
+  Parameter Amplitude{"Amplitude", "Tone", 0.1, 0.0, 0.5};
+  Parameter Detune{"Detune", "Tone", 0.003, 0.0, 0.05};
+
+  PresetMorph morph;
+  double phase1{0}, phase2{0};
+
+  al::rnd::Random<> randomGenerator;
+
+  ControlGUI gui;
+};
+
+int main() {
+  MyApp app;
+  app.configureAudio(44100, 256, 2, 0);
+  app.start();
+  return 0;
+}
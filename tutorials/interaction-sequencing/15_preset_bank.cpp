@@ -0,0 +1,134 @@
+#include <sys/stat.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "al/app/al_App.hpp"
+#include "al/graphics/al_Shapes.hpp"
+#include "al/math/al_Random.hpp"
+#include "al/ui/al_ControlGUI.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "PresetBank.hpp"
+
+using namespace al;
+
+/* PresetHandler (03_presets.cpp) stores each preset in a text file and
+ * reads it on every recall. With a few presets that is fine; an
+ * installation with thousands of them starts slowly and does file I/O
+ * whenever a preset is recalled.
+ *
+ * Here presets live in one binary bank that is memory mapped at startup.
+ * The bank is made on the first run, from the presets stored by
+ * 03_presets.cpp if there are any, or with 10000 random presets otherwise.
+ *
+ * Keys:
+ *   0..9    recall a preset
+ *   space   recall a different preset every frame
+ *   e       export the bank as PresetHandler text files to bankExport/
+ */
+
+#define BANK_FILE "presets.bank"
+#define NUM_RANDOM_PRESETS 10000
+
+class MyApp : public App {
+public:
+  void onCreate() override {
+    nav().pos(Vec3d(0, 0, 8));
+    addCone(mesh);
+    mesh.primitive(Mesh::LINE_STRIP);
+
+    gui << X << Y << Size;
+    gui.init();
+
+    makeBank();
+
+    auto start = std::chrono::steady_clock::now();
+    bank << X << Y << Size;
+    if (!bank.open(BANK_FILE)) {
+      std::cout << "Could not open " << BANK_FILE << std::endl;
+    }
+    std::cout << "Opened " << bank.presetCount() << " presets in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms" << std::endl;
+  }
+
+  // Build the bank file, once. Delete it to import again.
+  void makeBank() {
+    struct stat st;
+    if (stat(BANK_FILE, &st) == 0) {
+      return;
+    }
+    PresetBankWriter writer;
+    int imported = writer.importPresetHandler("sequencerPresets");
+    if (imported > 0) {
+      std::cout << "Imported " << imported << " presets" << std::endl;
+    } else {
+      std::vector<Parameter *> params{&X, &Y, &Size};
+      for (int i = 0; i < NUM_RANDOM_PRESETS; i++) {
+        X = randomGenerator.uniformS();
+        Y = randomGenerator.uniformS();
+        Size = 0.1 + randomGenerator.uniform() * 2.0;
+        writer.add(i, "random " + std::to_string(i), params);
+      }
+    }
+    writer.write(BANK_FILE);
+  }
+
+  void onAnimate(double dt) override {
+    navControl().active(!gui.usingInput());
+    if (flipping && bank.presetCount() > 0) {
+      // A recall is a copy from memory, cheap enough for every frame
+      bank.recall(bank.presetIndex(frame++ % bank.presetCount()));
+    }
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear();
+    g.pushMatrix();
+    g.translate(X.get(), Y.get(), 0);
+    g.scale(Size.get());
+    g.draw(mesh);
+    g.popMatrix();
+    gui.draw(g);
+  }
+
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.isNumber()) {
+      if (!bank.recall(k.keyAsNumber())) {
+        std::cout << "No preset " << k.keyAsNumber() << std::endl;
+      }
+    } else if (k.key() == ' ') {
+      flipping = !flipping;
+    } else if (k.key() == 'e') {
+      mkdir("bankExport", 0755);
+      if (bank.exportPresetHandler("bankExport")) {
+        std::cout << "Exported to bankExport/" << std::endl;
+      }
+    }
+    return true;
+  }
+
+private:
+  Mesh mesh;
+
+  Parameter X{"X", "Position", 0.0, -1.0f, 1.0f};
+  Parameter Y{"Y", "Position", 0.0, -1.0f, 1.0f};
+  Parameter Size{"Scale", "Size", 1.0, 0.1f, 3.0f};
+
+  PresetBank bank;
+  bool flipping{false};
+  uint32_t frame{0};
+
+  al::rnd::Random<> randomGenerator;
+
+  ControlGUI gui;
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "al/app/al_App.hpp"
+#include "al/math/al_Random.hpp"
+
+#include "AgentBundle.hpp"
+
+using namespace al;
+
+/* 09_bundles.cpp gives every agent its own Parameter objects grouped in a
+ * ParameterBundle. Here 10000 agents live in one AgentBundle: each field
+ * (x, y, speed) is one array over all agents, registered once.
+ * Moving and drawing the agents walks those arrays, agents come and go at
+ * any time, and the whole set is stored as a preset or sent over the
+ * network in one message.
+ *
+ * The bundle is sent to this same application every frame and applied to
+ * a second bundle, drawn in red, which follows the white one (on a
+ * cluster the receiver would be another machine).
+ *
+ * Keys:
+ *   a           add 1000 agents
+ *   r           remove 1000 random agents
+ *   alt + 0..9  store a preset of all agents
+ *   0..9        recall it
+ */
+
+#define NUM_AGENTS 10000
+
+class MyApp : public App {
+public:
+  void onCreate() override {
+    nav().pos(Vec3d(0, 0, 4));
+
+    for (AgentBundle *b : {&agents, &mirror}) {
+      b->field("x", 0, -1, 1);
+      b->field("y", 0, -1, 1);
+      b->field("speed", 0.1, 0, 1);
+    }
+    addAgents(NUM_AGENTS);
+
+    receiver.open(9140);
+    sender.addListener("127.0.0.1", 9140);
+  }
+
+  void addAgents(int n) {
+    for (int i = 0; i < n; i++) {
+      uint32_t id = agents.add();
+      agents.set(id, X, rnd::uniformS());
+      agents.set(id, Y, rnd::uniformS());
+      agents.set(id, SPEED, rnd::uniform(0.05, 0.5));
+    }
+  }
+
+  void onAnimate(double dt) override {
+    // One pass over contiguous arrays updates every agent
+    float *x = agents.values(X);
+    float *y = agents.values(Y);
+    const float *speed = agents.values(SPEED);
+    time += dt;
+    for (size_t i = 0; i < agents.size(); i++) {
+      x[i] += speed[i] * dt * std::cos(time + i);
+      y[i] += speed[i] * dt * std::sin(time * 1.3 + i);
+      x[i] = std::max(-1.0f, std::min(1.0f, x[i]));
+      y[i] = std::max(-1.0f, std::min(1.0f, y[i]));
+    }
+
+    sender.send(agents);
+    receiver.receive(mirror);
+
+    build(agents, mesh, 0);
+    build(mirror, mirrorMesh, 0.01);
+  }
+
+  void build(const AgentBundle &b, Mesh &m, float z) {
+    m.reset();
+    m.primitive(Mesh::POINTS);
+    const float *x = b.values(X);
+    const float *y = b.values(Y);
+    for (size_t i = 0; i < b.size(); i++) {
+      m.vertex(x[i], y[i], z);
+    }
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear();
+    g.pointSize(2);
+    g.color(1);
+    g.draw(mesh);
+    g.color(1, 0, 0);
+    g.draw(mirrorMesh);
+  }
+
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.isNumber()) {
+      if (k.alt()) {
+        agents.storePreset(k.keyAsNumber());
+        std::cout << "Stored " << agents.size() << " agents" << std::endl;
+      } else if (agents.recallPreset(k.keyAsNumber())) {
+        std::cout << "Recalled " << agents.size() << " agents" << std::endl;
+      }
+    } else if (k.key() == 'a') {
+      addAgents(1000);
+    } else if (k.key() == 'r') {
+      for (int i = 0; i < 1000 && agents.size() > 0; i++) {
+        agents.remove(agents.idAt(rnd::uniform(int(agents.size()))));
+      }
+    }
+    return true;
+  }
+
+private:
+  enum { X = 0, Y, SPEED }; // Field indices, in registration order
+
+  AgentBundle agents{"agents"};
+  AgentBundle mirror{"agents"};
+  AgentBundleSync sender, receiver;
+  Mesh mesh, mirrorMesh;
+  double time{0};
+};
+
+int main() {
+  MyApp app;
+  app.start();
+  return 0;
+}
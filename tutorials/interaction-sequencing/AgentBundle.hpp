@@ -0,0 +1,355 @@
+#pragma once
+#ifndef AgentBundle_H
+#define AgentBundle_H
+
+/*
+Parameters of many agents, stored as arrays.
+
+A ParameterBundle (09_bundles.cpp) groups Parameter objects that live
+inside each agent. Every Parameter has its own name, callbacks and mutex,
+the bundles must be registered one by one, and their number is fixed.
+That is fine for five voices, not for ten thousand agents that come and
+go.
+
+AgentBundle registers its fields once and stores the values of all agents
+as one contiguous array per field (structure of arrays), so updating or
+drawing every agent is a linear walk through memory:
+
+  AgentBundle agents{"agents"};
+  int x = agents.field("x", 0, -1, 1);
+  uint32_t id = agents.add();
+  agents.set(id, x, 0.5);
+  float* xs = agents.values(x);  // agents.size() values
+
+Agents are added and removed in O(1). Removing moves the last agent into
+the free slot, so slots change but ids stay valid until the agent is
+removed. The whole bundle is serialized, stored as a preset and sent to
+other machines (AgentBundleSync) as one block.
+
+An AgentBundle is not thread safe; use it from one thread, e.g. the
+graphics thread.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../allosphere/UdpSocket.hpp"
+
+class AgentBundle {
+public:
+  // Ids of removed agents are reused, so ids stay below the largest number
+  // of agents the bundle held at once. deserialize() rejects ids from
+  // MAX_IDS on, so a corrupt or hostile message cannot make it allocate an
+  // id map of gigabytes.
+  static const uint32_t MAX_IDS = 1 << 20;
+
+  explicit AgentBundle(const std::string& name) : mName(name) {}
+
+  const std::string& name() const { return mName; }
+
+  // Register a field. Do this before adding agents. Returns the field index.
+  int field(const std::string& name, float defaultValue = 0,
+            float min = -1e30f, float max = 1e30f) {
+    mFields.push_back({name, defaultValue, min, max});
+    mValues.emplace_back(mIds.size(), defaultValue);
+    return int(mFields.size()) - 1;
+  }
+
+  int fields() const { return int(mFields.size()); }
+  const std::string& fieldName(int f) const { return mFields[f].name; }
+
+  // Index of a field by name, or -1
+  int fieldIndex(const std::string& name) const {
+    for (size_t f = 0; f < mFields.size(); f++) {
+      if (mFields[f].name == name) return int(f);
+    }
+    return -1;
+  }
+
+  // Add an agent with default values. Returns its id.
+  uint32_t add() {
+    uint32_t id;
+    if (!mFreeIds.empty()) {
+      id = mFreeIds.back();
+      mFreeIds.pop_back();
+    } else {
+      id = uint32_t(mSlotOf.size());
+      mSlotOf.push_back(-1);
+    }
+    mSlotOf[id] = int32_t(mIds.size());
+    mIds.push_back(id);
+    for (size_t f = 0; f < mFields.size(); f++) {
+      mValues[f].push_back(mFields[f].defaultValue);
+    }
+    return id;
+  }
+
+  bool remove(uint32_t id) {
+    if (!contains(id)) return false;
+    size_t slot = size_t(mSlotOf[id]);
+    size_t last = mIds.size() - 1;
+    if (slot != last) {
+      // move the last agent into the hole
+      mIds[slot] = mIds[last];
+      mSlotOf[mIds[slot]] = int32_t(slot);
+      for (auto& values : mValues) values[slot] = values[last];
+    }
+    mIds.pop_back();
+    for (auto& values : mValues) values.pop_back();
+    mSlotOf[id] = -1;
+    mFreeIds.push_back(id);
+    return true;
+  }
+
+  void clear() {
+    while (!mIds.empty()) remove(mIds.back());
+  }
+
+  size_t size() const { return mIds.size(); }
+
+  bool contains(uint32_t id) const {
+    return id < mSlotOf.size() && mSlotOf[id] >= 0;
+  }
+
+  // Slot of agent id in the value arrays, or -1
+  int32_t slotOf(uint32_t id) const { return contains(id) ? mSlotOf[id] : -1; }
+  uint32_t idAt(size_t slot) const { return mIds[slot]; }
+
+  // All values of a field, one per agent, in slot order
+  float* values(int f) { return mValues[f].data(); }
+  const float* values(int f) const { return mValues[f].data(); }
+
+  float get(uint32_t id, int f) const { return mValues[f][mSlotOf[id]]; }
+
+  void set(uint32_t id, int f, float value) {
+    mValues[f][mSlotOf[id]] =
+        std::max(mFields[f].min, std::min(mFields[f].max, value));
+  }
+
+  // Whole bundle: ids, then one array per field
+
+  void serialize(std::vector<uint8_t>& out) const {
+    Header h;
+    std::memcpy(h.magic, "AGB1", 4);
+    h.fields = uint32_t(mFields.size());
+    h.agents = uint32_t(mIds.size());
+    out.resize(sizeof(h) + h.agents * sizeof(uint32_t) +
+               h.fields * h.agents * sizeof(float));
+    uint8_t* p = out.data();
+    std::memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    std::memcpy(p, mIds.data(), mIds.size() * sizeof(uint32_t));
+    p += mIds.size() * sizeof(uint32_t);
+    for (auto& values : mValues) {
+      std::memcpy(p, values.data(), values.size() * sizeof(float));
+      p += values.size() * sizeof(float);
+    }
+  }
+
+  // Replace all agents with serialized ones. Fails, leaving the agents as
+  // they were, if the fields differ in number or the ids are invalid:
+  // repeated, or not below MAX_IDS.
+  bool deserialize(const uint8_t* data, size_t size) {
+    Header h;
+    if (size < sizeof(h)) return false;
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, "AGB1", 4) != 0 || h.fields != mFields.size() ||
+        size < sizeof(h) + size_t(h.agents) * (sizeof(uint32_t) +
+                                               h.fields * sizeof(float))) {
+      return false;
+    }
+    // check the ids and build their map before anything is replaced
+    const uint8_t* p = data + sizeof(h);
+    std::vector<uint32_t> ids(h.agents);
+    std::memcpy(ids.data(), p, h.agents * sizeof(uint32_t));
+    p += h.agents * sizeof(uint32_t);
+    uint64_t maxId = 0;
+    for (uint32_t id : ids) maxId = std::max(maxId, uint64_t(id) + 1);
+    if (maxId > MAX_IDS) return false;
+    std::vector<int32_t> slotOf(maxId, -1);
+    for (size_t slot = 0; slot < ids.size(); slot++) {
+      if (slotOf[ids[slot]] >= 0) return false;  // duplicate id
+      slotOf[ids[slot]] = int32_t(slot);
+    }
+    mIds.swap(ids);
+    mSlotOf.swap(slotOf);
+    for (auto& values : mValues) {
+      values.resize(h.agents);
+      std::memcpy(values.data(), p, h.agents * sizeof(float));
+      p += h.agents * sizeof(float);
+    }
+    mFreeIds.clear();
+    for (uint32_t id = uint32_t(maxId); id-- > 0;) {
+      if (mSlotOf[id] < 0) mFreeIds.push_back(id);
+    }
+    return true;
+  }
+
+  // Presets of the whole bundle, kept in memory
+
+  void storePreset(int index) { serialize(mPresets[index]); }
+
+  bool recallPreset(int index) {
+    auto it = mPresets.find(index);
+    return it != mPresets.end() &&
+           deserialize(it->second.data(), it->second.size());
+  }
+
+  bool hasPreset(int index) const { return mPresets.count(index) > 0; }
+
+  bool save(const std::string& path) const {
+    std::vector<uint8_t> data;
+    serialize(data);
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write((const char*)data.data(), data.size());
+    return f.good();
+  }
+
+  bool load(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)),
+                              std::istreambuf_iterator<char>());
+    return deserialize(data.data(), data.size());
+  }
+
+private:
+  struct Field {
+    std::string name;
+    float defaultValue, min, max;
+  };
+
+  struct Header {
+    char magic[4];
+    uint32_t fields;
+    uint32_t agents;
+  };
+
+  std::string mName;
+  std::vector<Field> mFields;
+  std::vector<std::vector<float>> mValues;  // [field][slot]
+  std::vector<uint32_t> mIds;               // [slot]
+  std::vector<int32_t> mSlotOf;             // [id], -1 if free
+  std::vector<uint32_t> mFreeIds;
+  std::map<int, std::vector<uint8_t>> mPresets;
+};
+
+// Sends a whole AgentBundle to other machines as one message, split into
+// datagrams, and applies received ones. A message is applied only once all
+// its datagrams arrived; when a newer message starts, an incomplete older
+// one is dropped. Messages carry the sender's session, chosen when it
+// starts, so a restarted sender is followed even though it counts its
+// messages from 1 again.
+class AgentBundleSync {
+public:
+  explicit AgentBundleSync(size_t datagramSize = 32768)
+      : mChunk(datagramSize - sizeof(Part)), mSession(newSession()) {}
+
+  bool addListener(const std::string& host, uint16_t port) {
+    if (!mSocket.opened() && !mSocket.open()) return false;
+    return mSocket.addDestination(host, port);
+  }
+
+  bool open(uint16_t port) {
+    mDatagram.resize(65536);
+    return mSocket.open(port);
+  }
+
+  // Send the bundle. Call once per frame, or when it changed.
+  void send(const AgentBundle& bundle) {
+    bundle.serialize(mOutgoing);
+    Part part;
+    std::memcpy(part.magic, "AGBS", 4);
+    part.session = mSession;
+    part.message = ++mSent;
+    part.total = uint32_t(mOutgoing.size());
+    part.parts = uint32_t((mOutgoing.size() + mChunk - 1) / mChunk);
+    mOutgoingDatagram.resize(sizeof(Part) + mChunk);
+    for (part.index = 0; part.index < part.parts; part.index++) {
+      size_t offset = part.index * mChunk;
+      size_t n = std::min(mChunk, mOutgoing.size() - offset);
+      part.offset = uint32_t(offset);
+      std::memcpy(mOutgoingDatagram.data(), &part, sizeof(part));
+      std::memcpy(mOutgoingDatagram.data() + sizeof(part),
+                  mOutgoing.data() + offset, n);
+      mSocket.send(mOutgoingDatagram.data(), sizeof(part) + n);
+    }
+  }
+
+  // Read pending datagrams and apply the newest complete message to bundle.
+  // Returns true if one was applied.
+  bool receive(AgentBundle& bundle) {
+    bool applied = false;
+    mDatagram.resize(65536);
+    int size;
+    while ((size = mSocket.receive(mDatagram.data(), mDatagram.size())) >= 0) {
+      Part part;
+      if (size_t(size) < sizeof(part)) continue;
+      std::memcpy(&part, mDatagram.data(), sizeof(part));
+      if (std::memcmp(part.magic, "AGBS", 4) != 0 || part.index >= part.parts)
+        continue;
+      if (part.session != mReceivingSession) {  // the sender restarted
+        mReceivingSession = part.session;
+        mReceiving = 0;
+      }
+      if (part.message < mReceiving) continue;  // older message
+      if (part.message != mReceiving) {
+        mReceiving = part.message;
+        mMessage.assign(part.total, 0);
+        mReceived.assign(part.parts, false);
+        mMissing = part.parts;
+      }
+      // the sender's datagram size may differ from ours
+      size_t offset = part.offset;
+      size_t n = size - sizeof(part);
+      if (mReceived[part.index] || offset + n > mMessage.size()) continue;
+      std::memcpy(mMessage.data() + offset, mDatagram.data() + sizeof(part), n);
+      mReceived[part.index] = true;
+      if (--mMissing == 0 &&
+          bundle.deserialize(mMessage.data(), mMessage.size())) {
+        applied = true;
+        mApplied++;
+      }
+    }
+    return applied;
+  }
+
+  uint64_t messagesSent() const { return mSent; }
+  uint64_t messagesApplied() const { return mApplied; }
+
+private:
+  struct Part {
+    char magic[4];
+    uint32_t session;
+    uint32_t message;
+    uint32_t index;
+    uint32_t parts;
+    uint32_t total;
+    uint32_t offset;  // of this part in the message, in bytes
+  };
+
+  static uint32_t newSession() {
+    std::random_device random;
+    return random() ^ uint32_t(std::chrono::steady_clock::now()
+                                   .time_since_epoch()
+                                   .count());
+  }
+
+  size_t mChunk;
+  uint32_t mSession, mReceivingSession = 0;
+  UdpSocket mSocket;
+  std::vector<uint8_t> mOutgoing, mOutgoingDatagram;
+  std::vector<uint8_t> mMessage, mDatagram;  // being received
+  std::vector<bool> mReceived;
+  uint32_t mSent = 0, mReceiving = 0, mMissing = 0;
+  uint64_t mApplied = 0;
+};
+
+#endif
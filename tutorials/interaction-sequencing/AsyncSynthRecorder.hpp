@@ -0,0 +1,297 @@
+#pragma once
+#ifndef AsyncSynthRecorder_H
+#define AsyncSynthRecorder_H
+
+/*
+Recording PolySynth events without I/O on the triggering thread.
+
+SynthRecorder formats every trigger event as text when it happens, on the
+thread that triggered it (GUI, MIDI or audio), and prints it there in
+verbose mode. During a long live performance that is string formatting
+and console or file I/O on threads that should not wait for either.
+
+AsyncSynthRecorder registers the same PolySynth trigger callbacks, but
+they only copy the event (time, id, voice type, trigger parameters) into a
+preallocated lock-free ring. A background thread takes events from the
+ring in batches, formats them and writes them to a .synthSequence file in
+the format SynthSequencer plays:
+
+  + absTime eventId synthName pFields...
+  - absTime eventId
+
+  AsyncSynthRecorder recorder;
+  recorder.attach(synth);
+  recorder.verbose(true);          // also print them, from the writer thread
+  recorder.start("take1.synthSequence");
+  ...
+  recorder.stop();                 // writes what is left and closes
+
+start() without a path only prints. If the ring is full, events are
+counted as dropped rather than waited for. Events are tagged with the take
+they were recorded in, so an event that reaches the ring after stop()
+is dropped instead of written to the next take.
+
+To print the events of the synthesis tutorials, use printTriggerEvents()
+(../synthesis/TriggerEventLog.hpp), which shares one recorder.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeindex>
+#include <typeinfo>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+#include "al/scene/al_PolySynth.hpp"
+
+class AsyncSynthRecorder {
+public:
+  static const int MAX_FIELDS = 32;
+
+  // capacity: events held between writes, a power of two
+  explicit AsyncSynthRecorder(size_t capacity = 8192)
+      : mRing(std::make_shared<Ring>(capacity)) {}
+
+  // The callbacks registered by attach() share the ring, not the recorder,
+  // so a synth may outlive the recorder: its events are then ignored.
+  ~AsyncSynthRecorder() { stop(); }
+
+  // Record the events of synth. Call once, before triggering starts.
+  void attach(al::PolySynth& synth) {
+    std::shared_ptr<Ring> ring = mRing;
+    synth.registerTriggerOnCallback(
+        [ring](al::SynthVoice* voice, int, int id, void*) {
+          ring->triggerOn(voice, id);
+          return true;
+        });
+    synth.registerTriggerOffCallback([ring](int id, void*) {
+      ring->triggerOff(id);
+      return true;
+    });
+  }
+
+  // Name written for voices of type TVoice. By default the class name is
+  // used.
+  template <class TVoice>
+  void synthName(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mNamesMutex);
+    mNames[std::type_index(typeid(TVoice))] = name;
+  }
+
+  // Also print events to stdout, from the writer thread
+  void verbose(bool v) { mVerbose = v; }
+
+  // Start capturing events, writing them to path if there is one
+  bool start(const std::string& path = "") {
+    stop();
+    if (!path.empty()) {
+      mFile = std::fopen(path.c_str(), "w");
+      if (!mFile) return false;
+      std::setvbuf(mFile, nullptr, _IOFBF, 1 << 16);
+    }
+    mRing->start = std::chrono::steady_clock::now().time_since_epoch().count();
+    uint32_t take = (mRing->state.load() >> 1) + 1;
+    mRunning = true;
+    mThread = std::thread([this, take] { run(take); });
+    mRing->state.store(take << 1 | RECORDING, std::memory_order_release);
+    return true;
+  }
+
+  // Stop, write the remaining events and close the file
+  void stop() {
+    mRing->state.fetch_and(~RECORDING, std::memory_order_release);
+    if (mRunning.exchange(false)) mThread.join();
+    if (mFile) {
+      std::fclose(mFile);
+      mFile = nullptr;
+    }
+  }
+
+  bool recording() const {
+    return mRing->state.load(std::memory_order_acquire) & RECORDING;
+  }
+
+  uint64_t eventsRecorded() const { return mRing->recorded.load(); }
+  uint64_t eventsDropped() const { return mRing->dropped.load(); }
+  uint64_t eventsWritten() const { return mWritten.load(); }
+
+  // Called on the triggering threads through attach()
+  void triggerOn(al::SynthVoice* voice, int id) { mRing->triggerOn(voice, id); }
+  void triggerOff(int id) { mRing->triggerOff(id); }
+
+private:
+  static const uint32_t RECORDING = 1;  // low bit of Ring::state
+
+  struct Event {
+    uint32_t take = 0;
+    double time = 0;
+    bool on = false;
+    int id = 0;
+    const std::type_info* type = nullptr;
+    int count = 0;
+    float fields[MAX_FIELDS];
+  };
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Event event;
+  };
+
+  // Bounded multi-producer queue (Vyukov): a producer claims a cell by
+  // advancing enqueue, fills it and publishes it through its sequence
+  struct Ring {
+    explicit Ring(size_t capacity)
+        : cells(new Cell[capacity]), mask(capacity - 1) {
+      for (size_t i = 0; i < capacity; i++) cells[i].sequence.store(i);
+    }
+
+    void triggerOn(al::SynthVoice* voice, int id) {
+      Event e;
+      if (!begin(e)) return;
+      e.on = true;
+      e.id = id;
+      e.type = &typeid(*voice);
+      e.count = voice->getTriggerParams(e.fields, MAX_FIELDS);
+      push(e);
+    }
+
+    void triggerOff(int id) {
+      Event e;
+      if (!begin(e)) return;
+      e.on = false;
+      e.id = id;
+      push(e);
+    }
+
+    // Tag e with the current take. The take and whether it is recording
+    // are read together, so an event is never tagged with a take other
+    // than the one it saw recording.
+    bool begin(Event& e) {
+      uint32_t s = state.load(std::memory_order_acquire);
+      if (!(s & RECORDING)) return false;
+      e.take = s >> 1;
+      return true;
+    }
+
+    void push(Event& e) {
+      auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+      e.time = double(now - start.load(std::memory_order_relaxed)) *
+               std::chrono::steady_clock::period::num /
+               std::chrono::steady_clock::period::den;
+      size_t pos = enqueue.load(std::memory_order_relaxed);
+      Cell* cell;
+      for (;;) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+          if (enqueue.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed))
+            break;
+        } else if (diff < 0) {
+          dropped++;  // full
+          return;
+        } else {
+          pos = enqueue.load(std::memory_order_relaxed);
+        }
+      }
+      cell->event = e;
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      recorded++;
+    }
+
+    // Writer thread
+    bool pop(Event& e) {
+      Cell* cell = &cells[dequeue & mask];
+      if (cell->sequence.load(std::memory_order_acquire) != dequeue + 1)
+        return false;
+      e = cell->event;
+      cell->sequence.store(dequeue + mask + 1, std::memory_order_release);
+      dequeue++;
+      return true;
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> enqueue{0};
+    size_t dequeue = 0;  // writer thread
+
+    std::atomic<uint32_t> state{0};  // take << 1 | RECORDING
+    std::atomic<std::chrono::steady_clock::rep> start{0};
+    std::atomic<uint64_t> recorded{0}, dropped{0};
+  };
+
+  void run(uint32_t take) {
+    Event e;
+    char line[1024];
+    for (;;) {
+      bool running = mRunning.load();
+      int batch = 0;
+      while (mRing->pop(e)) {
+        // pushed by a thread that saw a previous take still recording
+        if (e.take != take) continue;
+        int n = format(e, line, sizeof(line));
+        if (mFile) std::fwrite(line, 1, n, mFile);
+        if (mVerbose) std::fwrite(line, 1, n, stdout);
+        batch++;
+      }
+      if (batch > 0) {
+        if (mFile) std::fflush(mFile);
+        if (mVerbose) std::fflush(stdout);
+        mWritten += batch;
+      }
+      if (!running) break;  // drained after stop()
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+
+  int format(const Event& e, char* line, size_t size) {
+    if (!e.on) {
+      return std::snprintf(line, size, "- %f %i\n", e.time, e.id);
+    }
+    int n = std::snprintf(line, size, "+ %f %i %s", e.time, e.id,
+                          name(e.type).c_str());
+    for (int i = 0; i < e.count && n < int(size) - 32; i++) {
+      n += std::snprintf(line + n, size - n, " %f", e.fields[i]);
+    }
+    n += std::snprintf(line + n, size - n, "\n");
+    return n;
+  }
+
+  const std::string& name(const std::type_info* type) {
+    std::lock_guard<std::mutex> lock(mNamesMutex);
+    auto it = mNames.find(std::type_index(*type));
+    if (it != mNames.end()) return it->second;
+    std::string n = type->name();
+#ifdef __GNUC__
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+    if (status == 0 && demangled) n = demangled;
+    std::free(demangled);
+#endif
+    return mNames[std::type_index(*type)] = n;
+  }
+
+  std::shared_ptr<Ring> mRing;  // shared with the attached synths
+  std::atomic<uint64_t> mWritten{0};
+
+  std::mutex mNamesMutex;  // names are looked up by the background thread
+  std::map<std::type_index, std::string> mNames;
+  std::atomic<bool> mVerbose{false};
+
+  FILE* mFile = nullptr;
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+};
+
+#endif
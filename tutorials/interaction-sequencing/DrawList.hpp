@@ -0,0 +1,118 @@
+#pragma once
+#ifndef DrawList_H
+#define DrawList_H
+
+/*
+Record draw calls once per frame and replay them for every view.
+
+onDraw() is called once per eye in stereo, once per window, and once per
+cube face in omni rendering. Traversing the scene in onDraw (walking the
+voices of a PolySynth, reading their parameters, computing transforms)
+therefore repeats the same CPU work several times per frame.
+
+A DrawList is filled once per frame, usually in onAnimate(), with the
+transforms, colors, uniforms and meshes of the scene. onDraw() then only
+replays it, and the view and projection are set by the renderer as usual.
+
+Commands are stored in a flat array that keeps its memory from frame to
+frame, so recording does not allocate once the list has grown to the size
+of the scene. Meshes and shaders are referenced, not copied: they must
+outlive the replay.
+*/
+
+#include <cassert>
+#include <vector>
+
+#include "al/graphics/al_Graphics.hpp"
+
+class DrawList {
+public:
+  // Forget the previous frame's commands, keeping their memory
+  void clear() { mCommands.clear(); }
+
+  void pushMatrix() { add(PUSH); }
+  void popMatrix() { add(POP); }
+  void translate(float x, float y, float z = 0) { add(TRANSLATE, x, y, z); }
+  void translate(const al::Vec3f& v) { add(TRANSLATE, v.x, v.y, v.z); }
+  void rotate(float degrees, float x, float y, float z) {
+    add(ROTATE, degrees, x, y, z);
+  }
+  void scale(float s) { add(SCALE, s, s, s); }
+  void scale(float x, float y, float z) { add(SCALE, x, y, z); }
+  void color(float r, float g, float b, float a = 1) { add(COLOR, r, g, b, a); }
+  void color(const al::Color& c) { add(COLOR, c.r, c.g, c.b, c.a); }
+
+  void shader(al::ShaderProgram& s) { add(SHADER).shader = &s; }
+  // Set a uniform of s, which must be the shader last selected with
+  // shader() in this list. name must stay valid until replay, e.g. a string
+  // literal.
+  void uniform(al::ShaderProgram& s, const char* name, float v) {
+    Command& c = add(UNIFORM, v);
+    c.shader = &s;
+    c.name = name;
+  }
+
+  void draw(const al::Mesh& mesh) { add(DRAW).mesh = &mesh; }
+
+  // Issue the recorded commands. Call in onDraw(), once per view.
+  void replay(al::Graphics& g) const {
+    const al::ShaderProgram* bound = nullptr;  // by a SHADER command
+    for (const Command& c : mCommands) {
+      switch (c.type) {
+      case PUSH:
+        g.pushMatrix();
+        break;
+      case POP:
+        g.popMatrix();
+        break;
+      case TRANSLATE:
+        g.translate(c.v[0], c.v[1], c.v[2]);
+        break;
+      case ROTATE:
+        g.rotate(c.v[0], c.v[1], c.v[2], c.v[3]);
+        break;
+      case SCALE:
+        g.scale(c.v[0], c.v[1], c.v[2]);
+        break;
+      case COLOR:
+        g.color(c.v[0], c.v[1], c.v[2], c.v[3]);
+        break;
+      case SHADER:
+        g.shader(*c.shader);
+        bound = c.shader;
+        break;
+      case UNIFORM:
+        assert(c.shader == bound && "uniform() of a shader not selected");
+        c.shader->uniform(c.name, c.v[0]);
+        break;
+      case DRAW:
+        g.draw(*c.mesh);
+        break;
+      }
+    }
+    (void)bound;  // only checked in debug builds
+  }
+
+  size_t size() const { return mCommands.size(); }
+  bool empty() const { return mCommands.empty(); }
+
+private:
+  enum Type { PUSH, POP, TRANSLATE, ROTATE, SCALE, COLOR, SHADER, UNIFORM, DRAW };
+
+  struct Command {
+    Type type;
+    float v[4];
+    const al::Mesh* mesh;
+    al::ShaderProgram* shader;
+    const char* name;
+  };
+
+  Command& add(Type type, float a = 0, float b = 0, float c = 0, float d = 0) {
+    mCommands.push_back(Command{type, {a, b, c, d}, nullptr, nullptr, nullptr});
+    return mCommands.back();
+  }
+
+  std::vector<Command> mCommands;
+};
+
+#endif
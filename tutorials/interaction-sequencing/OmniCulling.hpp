@@ -0,0 +1,222 @@
+#pragma once
+#ifndef OmniCulling_H
+#define OmniCulling_H
+
+/*
+Cube face planning and frustum culling for omni rendering.
+
+Omni rendering draws the scene six times, once into each face of a cube map,
+and then warps the cube map onto the projectors. A projector usually sees a
+part of the sphere only, so some faces are never sampled, and others are
+sampled at a much lower density than the cube map resolution.
+
+OmniFacePlan takes the direction every projector pixel looks at (the warp
+map of the projector) and computes, for every face, whether it is sampled
+at all and the face resolution at which one texel matches the spacing of
+the projector's pixels. Unused faces can be skipped and the others rendered
+at the required resolution only.
+
+ViewFrustum extracts the planes of the current view, so that objects
+outside of the face being rendered are not drawn. It works for any view,
+not only cube faces.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Faces in OpenGL cube map order
+enum CubeFace {
+  CUBE_POS_X = 0,
+  CUBE_NEG_X,
+  CUBE_POS_Y,
+  CUBE_NEG_Y,
+  CUBE_POS_Z,
+  CUBE_NEG_Z,
+  CUBE_FACES
+};
+
+class OmniFacePlan {
+public:
+  struct Face {
+    bool used = false;
+    float coverage = 0;  // fraction of the projector pixels on this face
+    int resolution = 0;  // texels per side needed to match pixel density
+  };
+
+  // Face of the cube a direction points to, and its coordinates on that
+  // face in [-1, 1]
+  static CubeFace faceOf(float x, float y, float z, float* u = nullptr,
+                         float* v = nullptr) {
+    float ax = std::fabs(x), ay = std::fabs(y), az = std::fabs(z);
+    CubeFace face;
+    float major, a, b;
+    if (ax >= ay && ax >= az) {
+      face = x > 0 ? CUBE_POS_X : CUBE_NEG_X;
+      major = ax;
+      a = z;
+      b = y;
+    } else if (ay >= az) {
+      face = y > 0 ? CUBE_POS_Y : CUBE_NEG_Y;
+      major = ay;
+      a = x;
+      b = z;
+    } else {
+      face = z > 0 ? CUBE_POS_Z : CUBE_NEG_Z;
+      major = az;
+      a = x;
+      b = y;
+    }
+    if (u) *u = major > 0 ? a / major : 0;
+    if (v) *v = major > 0 ? b / major : 0;
+    return face;
+  }
+
+  void clear() {
+    for (auto& f : mFaces) f = Face();
+    mCounts.assign(CUBE_FACES, 0);
+    mDensity.assign(CUBE_FACES, std::vector<float>());
+    mSamples = 0;
+  }
+
+  // Add the warp map of a projector: width * height directions, stored as
+  // consecutive xyz floats every `stride` floats (3 for packed xyz, 4 for
+  // xyzw). Directions of length 0 (pixels outside the screen) are ignored.
+  void addProjector(const float* directions, int width, int height,
+                    int stride = 3) {
+    if (mCounts.empty()) clear();
+    auto at = [&](int i, int j) { return directions + (j * width + i) * stride; };
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+        const float* d = at(i, j);
+        if (d[0] == 0 && d[1] == 0 && d[2] == 0) continue;
+        float u, v;
+        CubeFace face = faceOf(d[0], d[1], d[2], &u, &v);
+        mCounts[face]++;
+        mSamples++;
+
+        // distance to the next pixel in face coordinates, the face being 2
+        // units wide
+        float spacing = 0;
+        int neighbours = 0;
+        if (i + 1 < width) {
+          spacing += faceDistance(face, u, v, at(i + 1, j), neighbours);
+        }
+        if (j + 1 < height) {
+          spacing += faceDistance(face, u, v, at(i, j + 1), neighbours);
+        }
+        if (neighbours > 0 && spacing > 0) {
+          mDensity[face].push_back(2.0f * neighbours / spacing);
+        }
+      }
+    }
+  }
+
+  // Compute the plan from the projectors added. The resolution of a face is
+  // the density of its `percentile` densest pixels, rounded up to a
+  // multiple of `granularity` and clamped to [minResolution, maxResolution].
+  void compute(int minResolution = 128, int maxResolution = 4096,
+               float percentile = 0.95f, int granularity = 64) {
+    if (mCounts.empty()) clear();
+    for (int f = 0; f < CUBE_FACES; f++) {
+      Face& face = mFaces[f];
+      face.used = mCounts[f] > 0;
+      face.coverage = mSamples > 0 ? float(mCounts[f]) / mSamples : 0;
+      face.resolution = 0;
+      if (!face.used) continue;
+      std::vector<float>& d = mDensity[f];
+      float density = float(minResolution);
+      if (!d.empty()) {
+        size_t k = std::min(d.size() - 1, size_t(percentile * d.size()));
+        std::nth_element(d.begin(), d.begin() + k, d.end());
+        density = d[k];
+      }
+      int res = int(std::ceil(density / granularity)) * granularity;
+      face.resolution = std::max(minResolution, std::min(maxResolution, res));
+    }
+  }
+
+  const Face& face(int f) const { return mFaces[f]; }
+  bool used(int f) const { return mFaces[f].used; }
+  int resolution(int f) const { return mFaces[f].resolution; }
+
+  int usedFaces() const {
+    int n = 0;
+    for (auto& f : mFaces) n += f.used ? 1 : 0;
+    return n;
+  }
+
+  // Pixels rendered with this plan, relative to rendering all six faces at
+  // fullResolution
+  float cost(int fullResolution) const {
+    double pixels = 0;
+    for (auto& f : mFaces) pixels += double(f.resolution) * f.resolution;
+    return float(pixels / (6.0 * fullResolution * fullResolution));
+  }
+
+private:
+  // Distance on face between (u, v) and direction d, if d is on that face
+  static float faceDistance(CubeFace face, float u, float v, const float* d,
+                            int& neighbours) {
+    if (d[0] == 0 && d[1] == 0 && d[2] == 0) return 0;
+    float u2, v2;
+    if (faceOf(d[0], d[1], d[2], &u2, &v2) != face) return 0;
+    neighbours++;
+    return std::sqrt((u2 - u) * (u2 - u) + (v2 - v) * (v2 - v));
+  }
+
+  Face mFaces[CUBE_FACES];
+  std::vector<size_t> mCounts;
+  std::vector<std::vector<float>> mDensity;  // texels per side, per pixel
+  size_t mSamples = 0;
+};
+
+// The six planes of a view frustum, extracted from a view projection
+// matrix (Gribb & Hartmann)
+class ViewFrustum {
+public:
+  ViewFrustum() = default;
+
+  // m is a column major 4x4 matrix, as returned by Mat4f::elems(), that
+  // transforms from the space of the objects to test into clip space
+  // (projection * view * model)
+  explicit ViewFrustum(const float* m) { set(m); }
+
+  void set(const float* m) {
+    auto e = [m](int row, int col) { return m[col * 4 + row]; };
+    for (int i = 0; i < 3; i++) {
+      for (int s = 0; s < 2; s++) {
+        float sign = s == 0 ? 1.0f : -1.0f;
+        float* p = mPlanes[i * 2 + s];
+        for (int c = 0; c < 4; c++) p[c] = e(3, c) + sign * e(i, c);
+        float len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        if (len > 0) {
+          for (int c = 0; c < 4; c++) p[c] /= len;
+        }
+      }
+    }
+  }
+
+  // Multiply column major 4x4 matrices, e.g. to build projection * view
+  static void multiply(const float* a, const float* b, float* result) {
+    for (int col = 0; col < 4; col++) {
+      for (int row = 0; row < 4; row++) {
+        float sum = 0;
+        for (int k = 0; k < 4; k++) sum += a[k * 4 + row] * b[col * 4 + k];
+        result[col * 4 + row] = sum;
+      }
+    }
+  }
+
+  bool sphereVisible(float x, float y, float z, float radius) const {
+    for (auto& p : mPlanes) {
+      if (p[0] * x + p[1] * y + p[2] * z + p[3] < -radius) return false;
+    }
+    return true;
+  }
+
+private:
+  float mPlanes[6][4] = {};  // left, right, bottom, top, near, far
+};
+
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef ParameterBatch_H
+#define ParameterBatch_H
+
+/*
+Batched parameter change callbacks.
+
+A callback registered with Parameter::registerChangeCallback() runs on
+whatever thread sets the parameter (GUI, preset recall, OSC), once for
+every set. Callbacks that update DSP objects therefore race with the
+audio thread, and recalling a preset, or dragging a slider across a frame,
+runs them over and over with values nobody will hear.
+
+ParameterBatch registers its own callback, which only stores the value and
+sets the parameter's bit in a dirty bitset (lock and wait free). The
+handlers run when the owner calls dispatch(), e.g. at the start of each
+audio block or once per frame, on the owner's thread, once per changed
+parameter with its latest value:
+
+  batch.add(mFrequency, [this](float v) { mSource.freq(v); });
+  ...
+  void onProcess(AudioIOData &io) override {
+    batch.dispatch();
+    ...
+  }
+
+Register all parameters before they start changing on other threads.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "al/ui/al_Parameter.hpp"
+
+class ParameterBatch {
+public:
+  typedef std::function<void(float)> Handler;
+
+  // Call handler with the latest value of p on dispatch() after p changes
+  void add(al::Parameter& p, Handler handler) {
+    size_t index = mHandlers.size();
+    mHandlers.push_back(handler);
+    mValues.emplace_back(p.get());
+    if (index / 64 >= mDirty.size()) mDirty.emplace_back(0);
+    p.registerChangeCallback([this, index](float value) {
+      mValues[index].store(value, std::memory_order_relaxed);
+      mDirty[index / 64].fetch_or(uint64_t(1) << (index % 64),
+                                  std::memory_order_release);
+    });
+  }
+
+  // Run the handlers of the parameters changed since the last call. Returns
+  // the number of handlers run.
+  int dispatch() {
+    int count = 0;
+    for (size_t w = 0; w < mDirty.size(); w++) {
+      // skip clean words without writing to them
+      if (mDirty[w].load(std::memory_order_relaxed) == 0) continue;
+      uint64_t bits = mDirty[w].exchange(0, std::memory_order_acquire);
+      while (bits) {
+        int bit = lowestBit(bits);
+        bits &= bits - 1;
+        size_t index = w * 64 + bit;
+        mHandlers[index](mValues[index].load(std::memory_order_relaxed));
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // Run every handler with the current values, e.g. to initialize
+  void dispatchAll() {
+    for (auto& word : mDirty) word.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < mHandlers.size(); i++) {
+      mHandlers[i](mValues[i].load(std::memory_order_relaxed));
+    }
+  }
+
+  size_t size() const { return mHandlers.size(); }
+
+private:
+  static int lowestBit(uint64_t bits) {
+    int n = 0;
+    while (!(bits & 1)) {
+      bits >>= 1;
+      n++;
+    }
+    return n;
+  }
+
+  std::vector<Handler> mHandlers;
+  // deques, so registering does not move the atomics
+  std::deque<std::atomic<float>> mValues;
+  std::deque<std::atomic<uint64_t>> mDirty;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#pragma once
+#ifndef ParameterBundler_H
+#define ParameterBundler_H
+
+/*
+Coalesced, bundled OSC traffic for parameters.
+
+The parameter server sends one OSC message per parameter change, so dragging
+a slider or morphing a preset produces a stream of tiny packets, one per
+change of every parameter. ParameterBundleSender instead records changes as
+they happen (keeping only the last value of each parameter) and, once per
+frame, sends all parameters that changed as OSC bundles of up to one
+datagram each.
+
+Bundles are standard OSC, so any OSC receiver, including a ParameterServer,
+can read them. ParameterBundleReceiver is a receiver that applies bundles
+to registered parameters directly.
+
+Neither side allocates memory after registration: addresses are encoded
+once, changes are stored in per-parameter atomic slots and bundles are
+written into and parsed from fixed buffers.
+
+Only Parameter (float) and ParameterInt values are supported.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "al/ui/al_Parameter.hpp"
+
+#include "../allosphere/UdpSocket.hpp"
+
+// Writes OSC messages with a single float or int32 argument into an OSC
+// bundle held in a fixed buffer
+class OSCBundleWriter {
+public:
+  OSCBundleWriter(uint8_t* buffer, size_t capacity)
+      : mBuffer(buffer), mCapacity(capacity) {
+    clear();
+  }
+
+  // Start a new, empty bundle with an "immediately" time tag
+  void clear() {
+    std::memcpy(mBuffer, "#bundle\0", 8);
+    writeBE64(mBuffer + 8, 1);
+    mSize = 16;
+    mMessages = 0;
+  }
+
+  // Space a message with this encoded address needs
+  static size_t messageSize(size_t encodedAddressSize) {
+    return 4 + encodedAddressSize + 4 + 4;  // size, address, tags, argument
+  }
+
+  // Append a message. address must already be OSC encoded (null terminated
+  // and padded to 4 bytes). Returns false if the bundle is full.
+  bool add(const char* address, size_t addressSize, char type,
+           uint32_t bits) {
+    size_t size = messageSize(addressSize);
+    if (mSize + size > mCapacity) return false;
+    uint8_t* p = mBuffer + mSize;
+    writeBE32(p, uint32_t(size - 4));
+    std::memcpy(p + 4, address, addressSize);
+    p += 4 + addressSize;
+    p[0] = ',';
+    p[1] = uint8_t(type);
+    p[2] = p[3] = 0;
+    writeBE32(p + 4, bits);
+    mSize += size;
+    mMessages++;
+    return true;
+  }
+
+  bool empty() const { return mMessages == 0; }
+  size_t messages() const { return mMessages; }
+  const uint8_t* data() const { return mBuffer; }
+  size_t size() const { return mSize; }
+
+  // OSC encoded form of address: null terminated, padded to 4 bytes
+  static std::string encodeAddress(const std::string& address) {
+    std::string s = address;
+    s.push_back('\0');
+    while (s.size() % 4) s.push_back('\0');
+    return s;
+  }
+
+  static void writeBE32(uint8_t* p, uint32_t v) {
+    p[0] = uint8_t(v >> 24);
+    p[1] = uint8_t(v >> 16);
+    p[2] = uint8_t(v >> 8);
+    p[3] = uint8_t(v);
+  }
+
+  static void writeBE64(uint8_t* p, uint64_t v) {
+    writeBE32(p, uint32_t(v >> 32));
+    writeBE32(p + 4, uint32_t(v));
+  }
+
+private:
+  uint8_t* mBuffer;
+  size_t mCapacity;
+  size_t mSize = 0;
+  size_t mMessages = 0;
+};
+
+// Parses OSC packets (messages or nested bundles) in place and reports
+// messages whose first argument is a float or int32
+class OSCBundleReader {
+public:
+  // handler(const char* address, char type, uint32_t bits) is called for
+  // every message. Returns false if the packet is malformed.
+  template <class Handler>
+  static bool parse(const uint8_t* data, size_t size, Handler&& handler,
+                    int depth = 0) {
+    if (size < 8 || size % 4 != 0 || depth > 8) return false;
+    if (std::memcmp(data, "#bundle\0", 8) == 0) {
+      size_t pos = 16;  // skip time tag
+      while (pos + 4 <= size) {
+        uint32_t element = readBE32(data + pos);
+        pos += 4;
+        if (element > size - pos) return false;
+        if (!parse(data + pos, element, handler, depth + 1)) return false;
+        pos += element;
+      }
+      return pos == size;
+    }
+    return message(data, size, handler);
+  }
+
+  static uint32_t readBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  }
+
+private:
+  template <class Handler>
+  static bool message(const uint8_t* data, size_t size, Handler& handler) {
+    if (data[0] != '/') return false;
+    size_t addressEnd = padded(data, 0, size);
+    if (addressEnd == 0 || addressEnd >= size) return false;
+    const char* tags = (const char*)data + addressEnd;
+    if (tags[0] != ',') return false;
+    size_t argsBegin = padded(data, addressEnd, size);
+    if (argsBegin == 0) return false;
+    char type = tags[1];
+    if ((type == 'f' || type == 'i') && argsBegin + 4 <= size) {
+      handler((const char*)data, type, readBE32(data + argsBegin));
+    }
+    return true;
+  }
+
+  // position after the null terminated, 4 byte padded string at begin, or
+  // 0 if it is not terminated within size
+  static size_t padded(const uint8_t* data, size_t begin, size_t size) {
+    for (size_t i = begin; i < size; i++) {
+      if (data[i] == 0) return (i + 4) & ~size_t(3);
+    }
+    return 0;
+  }
+};
+
+// Sends changes of registered parameters as OSC bundles, once per flush()
+class ParameterBundleSender {
+public:
+  explicit ParameterBundleSender(size_t maxBundleSize = UdpSocket::safePayload())
+      : mBuffer(maxBundleSize) {}
+
+  // Register parameters before calling addListener() or flush()
+  ParameterBundleSender& operator<<(al::Parameter& p) {
+    add(p, 'f');
+    p.registerChangeCallback([this, index = mSlots.size() - 1](float v) {
+      uint32_t bits;
+      std::memcpy(&bits, &v, 4);
+      changed(index, bits);
+    });
+    return *this;
+  }
+
+  ParameterBundleSender& operator<<(al::ParameterInt& p) {
+    add(p, 'i');
+    p.registerChangeCallback([this, index = mSlots.size() - 1](int32_t v) {
+      changed(index, uint32_t(v));
+    });
+    return *this;
+  }
+
+  bool addListener(const std::string& host, uint16_t port) {
+    if (!mSocket.opened() && !mSocket.open()) return false;
+    return mSocket.addDestination(host, port);
+  }
+
+  // Send every parameter that changed since the last flush, last value
+  // wins. Call once per frame (or audio block).
+  void flush() {
+    OSCBundleWriter writer(mBuffer.data(), mBuffer.size());
+    for (Slot& slot : mSlots) {
+      if (!slot.dirty.exchange(false)) continue;
+      uint32_t bits = slot.bits.load();
+      if (!writer.add(slot.address.data(), slot.address.size(), slot.type,
+                      bits)) {
+        send(writer);
+        writer.clear();
+        writer.add(slot.address.data(), slot.address.size(), slot.type, bits);
+      }
+    }
+    if (!writer.empty()) send(writer);
+  }
+
+  // Set while a ParameterBundleReceiver applies values on this thread
+  static bool& applyingReceived() {
+    static thread_local bool applying = false;
+    return applying;
+  }
+
+  // Throughput counters
+  uint64_t changes() const { return mChanges.load(); }  // values set
+  uint64_t messagesSent() const { return mMessagesSent; }
+  uint64_t bundlesSent() const { return mBundlesSent; }
+  uint64_t bytesSent() const { return mBytesSent; }
+
+private:
+  struct Slot {
+    std::string address;  // OSC encoded
+    char type;
+    std::atomic<uint32_t> bits{0};
+    std::atomic<bool> dirty{false};
+  };
+
+  void add(al::ParameterMeta& p, char type) {
+    // slots are never moved once callbacks point at them
+    mSlots.emplace_back();
+    mSlots.back().address = OSCBundleWriter::encodeAddress(p.getFullAddress());
+    mSlots.back().type = type;
+  }
+
+  // May be called from any thread
+  void changed(size_t index, uint32_t bits) {
+    if (applyingReceived()) return;  // do not echo values we just received
+    mSlots[index].bits.store(bits);
+    mSlots[index].dirty.store(true);
+    mChanges++;
+  }
+
+  void send(const OSCBundleWriter& writer) {
+    mSocket.send(writer.data(), writer.size());
+    mMessagesSent += writer.messages();
+    mBundlesSent++;
+    mBytesSent += writer.size();
+  }
+
+  std::deque<Slot> mSlots;
+  std::vector<uint8_t> mBuffer;
+  UdpSocket mSocket;
+  std::atomic<uint64_t> mChanges{0};
+  uint64_t mMessagesSent = 0, mBundlesSent = 0, mBytesSent = 0;
+};
+
+// Receives OSC packets on a port and applies them to registered parameters
+class ParameterBundleReceiver {
+public:
+  ParameterBundleReceiver& operator<<(al::Parameter& p) {
+    add(p.getFullAddress(), &p, nullptr);
+    return *this;
+  }
+
+  ParameterBundleReceiver& operator<<(al::ParameterInt& p) {
+    add(p.getFullAddress(), nullptr, &p);
+    return *this;
+  }
+
+  bool open(uint16_t port) {
+    mBuffer.resize(65536);
+    return mSocket.open(port);
+  }
+
+  // Apply all pending packets. Call once per frame.
+  void poll() {
+    ParameterBundleSender::applyingReceived() = true;
+    int size;
+    while ((size = mSocket.receive(mBuffer.data(), mBuffer.size())) >= 0) {
+      mPackets++;
+      OSCBundleReader::parse(mBuffer.data(), size,
+                             [this](const char* address, char type,
+                                    uint32_t bits) { apply(address, type, bits); });
+    }
+    ParameterBundleSender::applyingReceived() = false;
+  }
+
+  uint64_t packetsReceived() const { return mPackets; }
+  uint64_t messagesApplied() const { return mApplied; }
+
+private:
+  struct Entry {
+    std::string address;
+    al::Parameter* parameter;
+    al::ParameterInt* parameterInt;
+  };
+
+  void add(const std::string& address, al::Parameter* p, al::ParameterInt* pi) {
+    Entry e{address, p, pi};
+    auto it = std::lower_bound(
+        mEntries.begin(), mEntries.end(), e,
+        [](const Entry& a, const Entry& b) { return a.address < b.address; });
+    mEntries.insert(it, e);
+  }
+
+  void apply(const char* address, char type, uint32_t bits) {
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), address,
+                               [](const Entry& e, const char* a) {
+                                 return std::strcmp(e.address.c_str(), a) < 0;
+                               });
+    if (it == mEntries.end() || std::strcmp(it->address.c_str(), address) != 0)
+      return;
+    float f;
+    std::memcpy(&f, &bits, 4);
+    int32_t i = int32_t(bits);
+    if (it->parameter) it->parameter->set(type == 'f' ? f : float(i));
+    if (it->parameterInt) it->parameterInt->set(type == 'i' ? i : int32_t(f));
+    mApplied++;
+  }
+
+  std::vector<Entry> mEntries;  // sorted by address
+  std::vector<uint8_t> mBuffer;
+  UdpSocket mSocket;
+  uint64_t mPackets = 0, mApplied = 0;
+};
+
+#endif
@@ -0,0 +1,388 @@
+#pragma once
+#ifndef PresetBank_H
+#define PresetBank_H
+
+/*
+Binary preset banks.
+
+PresetHandler keeps every preset in its own text file and reads and parses
+the file on every recall. An installation with thousands of presets opens
+thousands of files to list them, and recalling from the frame loop does
+file I/O.
+
+A preset bank is a single file: a header, a table of parameter addresses,
+and one fixed width row per preset (index, name, and a float per
+parameter). PresetBank maps the file into memory when it is opened, so
+opening is instant whatever the size, and recall() copies one row into the
+bound parameters: no I/O and no parsing. Values a preset does not have are
+stored as NaN and left alone on recall.
+
+PresetBankWriter builds banks, from code or by importing a PresetHandler
+directory (its .presetMap and .preset text files), and
+PresetBank::exportPresetHandler() writes a bank back in that format.
+
+Like UdpSocket, this relies on POSIX (mmap) and is not available on
+Windows.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "al/ui/al_Parameter.hpp"
+
+struct PresetBankFormat {
+  static const uint32_t VERSION = 1;
+  static const uint32_t NAME_WIDTH = 64;  // bytes, including the final 0
+
+  struct Header {
+    char magic[4];  // "ALPB"
+    uint32_t version;
+    uint32_t parameterCount;
+    uint32_t presetCount;
+  };
+
+  // A row is int32 index, char name[NAME_WIDTH], float values[parameterCount]
+  static size_t rowSize(uint32_t parameterCount) {
+    return sizeof(int32_t) + NAME_WIDTH + parameterCount * sizeof(float);
+  }
+};
+
+class PresetBank {
+public:
+  PresetBank() = default;
+  ~PresetBank() { close(); }
+  PresetBank(const PresetBank&) = delete;
+  PresetBank& operator=(const PresetBank&) = delete;
+
+  bool open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // the mapping stays valid
+    if (data == MAP_FAILED) return false;
+    mData = (const char*)data;
+    mSize = st.st_size;
+
+    // the counts come from the file: check them against its size without
+    // multiplications that can overflow
+    const Header* h = header();
+    size_t available = mSize - sizeof(Header);
+    size_t names = size_t(h->parameterCount) * PresetBankFormat::NAME_WIDTH;
+    if (std::memcmp(h->magic, "ALPB", 4) != 0 ||
+        h->version != PresetBankFormat::VERSION || names > available ||
+        h->presetCount > (available - names) / rowSize()) {
+      close();
+      return false;
+    }
+    // bring the rows in ahead of the first recalls
+    madvise((void*)mData, mSize, MADV_WILLNEED);
+
+    // names are read as C strings: each field must end within its width
+    for (uint32_t c = 0; c < parameterCount(); c++) {
+      if (!terminated(parameterAddress(c))) {
+        close();
+        return false;
+      }
+    }
+    for (uint32_t row = 0; row < presetCount(); row++) {
+      if (!terminated(presetName(row))) {
+        close();
+        return false;
+      }
+    }
+
+    // preset index -> row, for O(1) recall. Indices can be sparse, and
+    // any value a file holds, so they are hashed rather than used as
+    // positions.
+    mRowOf.reserve(presetCount());
+    for (uint32_t row = 0; row < presetCount(); row++) {
+      int32_t index = presetIndex(row);
+      if (index < 0) continue;
+      mRowOf[index] = int32_t(row);
+    }
+    bindAll();
+    return true;
+  }
+
+  void close() {
+    if (mData) munmap((void*)mData, mSize);
+    mData = nullptr;
+    mSize = 0;
+    mRowOf.clear();
+    for (auto& b : mBindings) b.column = -1;
+  }
+
+  bool isOpen() const { return mData != nullptr; }
+
+  uint32_t parameterCount() const { return mData ? header()->parameterCount : 0; }
+  uint32_t presetCount() const { return mData ? header()->presetCount : 0; }
+
+  const char* parameterAddress(uint32_t column) const {
+    return mData + sizeof(Header) +
+           size_t(column) * PresetBankFormat::NAME_WIDTH;
+  }
+
+  int32_t presetIndex(uint32_t row) const {
+    int32_t index;
+    std::memcpy(&index, rowData(row), sizeof(index));
+    return index;
+  }
+  const char* presetName(uint32_t row) const {
+    return rowData(row) + sizeof(int32_t);
+  }
+  const float* values(uint32_t row) const {
+    return (const float*)(rowData(row) + sizeof(int32_t) +
+                          PresetBankFormat::NAME_WIDTH);
+  }
+
+  // Row of preset index, or -1
+  int32_t find(int index) const {
+    auto it = mRowOf.find(index);
+    return it != mRowOf.end() ? it->second : -1;
+  }
+
+  // Bind a parameter to recall into, matched by OSC address (or
+  // "/" + name, as the synth voices store them). Can be done before or
+  // after open().
+  PresetBank& operator<<(al::Parameter& p) {
+    mBindings.push_back({&p, -1});
+    if (mData) bind(mBindings.back());
+    return *this;
+  }
+
+  // Set the bound parameters to preset index. Returns false if the bank has
+  // no such preset.
+  bool recall(int index) {
+    int32_t row = find(index);
+    if (row < 0) return false;
+    const float* v = values(row);
+    for (auto& b : mBindings) {
+      if (b.column >= 0 && !std::isnan(v[b.column])) b.parameter->set(v[b.column]);
+    }
+    return true;
+  }
+
+  // Write the bank as a PresetHandler directory: one .preset file per
+  // preset and mapName.presetMap
+  bool exportPresetHandler(const std::string& dir,
+                           const std::string& mapName = "default") const {
+    std::ofstream map(dir + "/" + mapName + ".presetMap");
+    if (!map.good()) return false;
+    for (uint32_t row = 0; row < presetCount(); row++) {
+      std::ofstream f(dir + "/" + presetName(row) + ".preset");
+      if (!f.good()) return false;
+      f << "::" << presetName(row) << std::endl;
+      const float* v = values(row);
+      char line[32];
+      for (uint32_t c = 0; c < parameterCount(); c++) {
+        if (std::isnan(v[c])) continue;
+        std::snprintf(line, sizeof(line), "%f", v[c]);
+        f << parameterAddress(c) << " f " << line << " " << std::endl;
+      }
+      f << "::" << std::endl;
+      map << presetIndex(row) << ":" << presetName(row) << std::endl;
+    }
+    map << "::" << std::endl;
+    return true;
+  }
+
+private:
+  typedef PresetBankFormat::Header Header;
+
+  struct Binding {
+    al::Parameter* parameter;
+    int32_t column;
+  };
+
+  const Header* header() const { return (const Header*)mData; }
+
+  static bool terminated(const char* name) {
+    return std::memchr(name, 0, PresetBankFormat::NAME_WIDTH) != nullptr;
+  }
+
+  size_t rowSize() const {
+    return PresetBankFormat::rowSize(header()->parameterCount);
+  }
+
+  const char* rowData(uint32_t row) const {
+    return mData + sizeof(Header) +
+           size_t(parameterCount()) * PresetBankFormat::NAME_WIDTH +
+           row * rowSize();
+  }
+
+  void bind(Binding& b) {
+    std::string address = b.parameter->getFullAddress();
+    std::string shortAddress = "/" + b.parameter->getName();
+    b.column = -1;
+    for (uint32_t c = 0; c < parameterCount(); c++) {
+      if (address == parameterAddress(c) || shortAddress == parameterAddress(c)) {
+        b.column = int32_t(c);
+        return;
+      }
+    }
+  }
+
+  void bindAll() {
+    for (auto& b : mBindings) bind(b);
+  }
+
+  const char* mData = nullptr;
+  size_t mSize = 0;
+  std::unordered_map<int32_t, int32_t> mRowOf;
+  std::vector<Binding> mBindings;
+};
+
+class PresetBankWriter {
+public:
+  // Names and addresses are stored in NAME_WIDTH bytes, with the final 0
+  static bool fits(const std::string& name) {
+    return name.size() < PresetBankFormat::NAME_WIDTH &&
+           name.find('\0') == std::string::npos;
+  }
+
+  // Column for a parameter address, added if new. Returns -1 if the
+  // address does not fit.
+  int parameter(const std::string& address) {
+    if (!fits(address)) return -1;
+    auto it = mColumns.find(address);
+    if (it != mColumns.end()) return it->second;
+    int column = int(mAddresses.size());
+    mColumns[address] = column;
+    mAddresses.push_back(address);
+    for (auto& p : mPresets) p.values.push_back(NAN);
+    return column;
+  }
+
+  // Add a preset with the values of parameters, by their address. Returns
+  // false, and adds nothing, if the name or an address does not fit.
+  bool add(int index, const std::string& name,
+           const std::vector<al::Parameter*>& parameters) {
+    if (!fits(name)) return false;
+    for (auto* param : parameters) {
+      if (!fits(param->getFullAddress())) return false;
+    }
+    Preset& p = newPreset(index, name);
+    for (auto* param : parameters) {
+      p.values[parameter(param->getFullAddress())] = param->get();
+    }
+    return true;
+  }
+
+  // Add a preset with one value per column. Values can be NaN. Returns
+  // false if the name does not fit.
+  bool add(int index, const std::string& name, const std::vector<float>& values) {
+    if (!fits(name)) return false;
+    Preset& p = newPreset(index, name);
+    for (size_t c = 0; c < values.size() && c < p.values.size(); c++) {
+      p.values[c] = values[c];
+    }
+    return true;
+  }
+
+  // Add the presets of a PresetHandler directory. Returns the number of
+  // presets read. Presets and values whose names do not fit are skipped.
+  int importPresetHandler(const std::string& dir,
+                          const std::string& mapName = "default") {
+    std::ifstream map(dir + "/" + mapName + ".presetMap");
+    std::string line;
+    int count = 0;
+    while (std::getline(map, line)) {
+      size_t colon = line.find(':');
+      if (line == "::" || colon == std::string::npos || colon == 0) continue;
+      int index = std::atoi(line.substr(0, colon).c_str());
+      std::string name = line.substr(colon + 1);
+      if (!fits(name)) continue;
+      std::ifstream f(dir + "/" + name + ".preset");
+      if (!f.good()) continue;
+      // lines are "/address type value", between "::name" and "::"
+      std::map<int, float> values;
+      while (std::getline(f, line)) {
+        if (line.empty() || line[0] != '/') continue;
+        std::istringstream fields(line);
+        std::string address, type;
+        float value;
+        int column;
+        if (fields >> address >> type >> value &&
+            (column = parameter(address)) >= 0) {
+          values[column] = value;
+        }
+      }
+      Preset& p = newPreset(index, name);
+      for (auto& v : values) p.values[v.first] = v.second;
+      count++;
+    }
+    return count;
+  }
+
+  size_t presetCount() const { return mPresets.size(); }
+
+  // Write the bank. The file is replaced atomically, so a bank mapped by a
+  // running application is not changed under it.
+  bool write(const std::string& path) const {
+    std::string temp = path + ".tmp";
+    {
+      std::ofstream f(temp, std::ios::binary | std::ios::trunc);
+      if (!f.good()) return false;
+      PresetBankFormat::Header h;
+      std::memcpy(h.magic, "ALPB", 4);
+      h.version = PresetBankFormat::VERSION;
+      h.parameterCount = uint32_t(mAddresses.size());
+      h.presetCount = uint32_t(mPresets.size());
+      f.write((const char*)&h, sizeof(h));
+      for (auto& a : mAddresses) writeName(f, a);
+      for (auto& p : mPresets) {
+        int32_t index = p.index;
+        f.write((const char*)&index, sizeof(index));
+        writeName(f, p.name);
+        f.write((const char*)p.values.data(), p.values.size() * sizeof(float));
+      }
+      if (!f.good()) return false;
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+  }
+
+private:
+  struct Preset {
+    int index;
+    std::string name;
+    std::vector<float> values;
+  };
+
+  Preset& newPreset(int index, const std::string& name) {
+    mPresets.push_back({index, name, std::vector<float>(mAddresses.size(), NAN)});
+    return mPresets.back();
+  }
+
+  // name fits(), checked when it was added
+  static void writeName(std::ofstream& f, const std::string& name) {
+    char buffer[PresetBankFormat::NAME_WIDTH] = {0};
+    std::memcpy(buffer, name.data(), name.size());
+    f.write(buffer, sizeof(buffer));
+  }
+
+  std::map<std::string, int> mColumns;
+  std::vector<std::string> mAddresses;
+  std::vector<Preset> mPresets;
+};
+
+#endif
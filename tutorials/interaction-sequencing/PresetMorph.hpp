@@ -0,0 +1,246 @@
+#pragma once
+#ifndef PresetMorph_H
+#define PresetMorph_H
+
+/*
+Preset morphing at audio rate.
+
+PresetHandler::setMorphTime() morphs by setting the parameters from a
+control thread at a coarse rate. A voice that reads a frequency or an
+amplitude parameter in onProcess() sees it jump once per step and the
+morph zippers.
+
+PresetMorph computes a ramp per parameter once, when a morph starts, and
+hands the targets to the audio thread through a triple buffer. The audio
+thread evaluates the ramps itself, per sample if it wants, without locks:
+
+  // audio thread
+  morph.process(io.framesPerBuffer(), io.framesPerSecond());
+  while (io()) {
+    float f = morph.value(0, io.frame());
+    ...
+  }
+
+Presets can also be blended: blend() morphs to a weighted mix of several
+stored presets, with weights from inverseDistanceWeights() (presets placed
+on a plane, e.g. under the mouse) or barycentricWeights() (three presets
+on a triangle).
+
+Registered parameters keep working as usual: changing one from the GUI
+ramps the audio value to it over a short smoothing time, and
+updateParameters() shows the audio thread's values on the parameters while
+a morph runs.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "al/ui/al_Parameter.hpp"
+
+#include "../synthesis/TripleBuffer.hpp"
+
+class PresetMorph {
+public:
+  static const int MAX_PARAMETERS = 32;
+
+  // Register a parameter, before audio starts. Parameters are numbered in
+  // registration order.
+  PresetMorph& operator<<(al::Parameter& p) {
+    if (int(mParameters.size()) == MAX_PARAMETERS) return *this;
+    int index = int(mParameters.size());
+    mParameters.push_back(&p);
+    float v = p.get();
+    mCommand.count = index + 1;
+    mCommand.target[index] = v;
+    mValue[index] = mGoal[index] = v;
+    mCurrent[index].store(v, std::memory_order_relaxed);
+    mCommands.reset(mCommand);
+    p.registerChangeCallback([this, index](float value) {
+      if (applying() == this) return;  // set by updateParameters()
+      std::lock_guard<std::mutex> lock(mSendMutex);
+      setTarget(index, value, mSmoothing);
+      mFollowAudio[index] = false;  // the parameter leads, e.g. a slider
+      mCommands.publish(mCommand);
+    });
+    return *this;
+  }
+
+  // Ramp time for changes made directly to the parameters
+  void smoothing(float seconds) { mSmoothing = seconds; }
+
+  // Store the current parameter values as preset index
+  void store(int index) {
+    std::vector<float>& values = mPresets[index];
+    values.resize(mParameters.size());
+    for (size_t i = 0; i < mParameters.size(); i++) {
+      values[i] = mParameters[i]->get();
+    }
+  }
+
+  bool hasPreset(int index) const { return mPresets.count(index) > 0; }
+
+  // Morph to preset index in seconds
+  bool morphTo(int index, float seconds) {
+    float weight = 1;
+    return blend(&index, &weight, 1, seconds);
+  }
+
+  // Morph to the weighted mix of n presets in seconds. Weights are
+  // normalized per parameter; missing presets are skipped, and so are
+  // presets stored before a parameter was registered, for that parameter.
+  // A parameter no preset has keeps its value.
+  bool blend(const int* presets, const float* weights, int n, float seconds) {
+    float mix[MAX_PARAMETERS] = {0};
+    float total[MAX_PARAMETERS] = {0};
+    bool found = false;
+    for (int k = 0; k < n; k++) {
+      auto it = mPresets.find(presets[k]);
+      if (it == mPresets.end() || weights[k] <= 0) continue;
+      size_t count = std::min<size_t>(it->second.size(), MAX_PARAMETERS);
+      for (size_t i = 0; i < count; i++) {
+        mix[i] += weights[k] * it->second[i];
+        total[i] += weights[k];
+      }
+      found = true;
+    }
+    if (!found) return false;
+    std::lock_guard<std::mutex> lock(mSendMutex);
+    for (int i = 0; i < mCommand.count; i++) {
+      if (total[i] <= 0) continue;
+      setTarget(i, mix[i] / total[i], seconds);
+      mFollowAudio[i] = true;
+    }
+    mCommands.publish(mCommand);
+    return true;
+  }
+
+  // Weights falling off with distance from (x, y) to the n points
+  // (px[k], py[k]). On a point, that point gets all the weight.
+  static void inverseDistanceWeights(const float* px, const float* py, int n,
+                                     float x, float y, float* weights,
+                                     float power = 2) {
+    for (int k = 0; k < n; k++) {
+      float d = std::hypot(x - px[k], y - py[k]);
+      if (d < 1e-6f) {
+        for (int j = 0; j < n; j++) weights[j] = j == k ? 1.0f : 0.0f;
+        return;
+      }
+      weights[k] = 1.0f / std::pow(d, power);
+    }
+  }
+
+  // Weights of (x, y) relative to the triangle a, b, c, clamped to its
+  // edges
+  static void barycentricWeights(float ax, float ay, float bx, float by,
+                                 float cx, float cy, float x, float y,
+                                 float weights[3]) {
+    float det = (by - cy) * (ax - cx) + (cx - bx) * (ay - cy);
+    if (std::fabs(det) < 1e-12f) {
+      weights[0] = 1;
+      weights[1] = weights[2] = 0;
+      return;
+    }
+    float a = ((by - cy) * (x - cx) + (cx - bx) * (y - cy)) / det;
+    float b = ((cy - ay) * (x - cx) + (ax - cx) * (y - cy)) / det;
+    weights[0] = std::max(0.0f, a);
+    weights[1] = std::max(0.0f, b);
+    weights[2] = std::max(0.0f, 1 - a - b);
+  }
+
+  // Graphics/GUI thread: show the values the audio thread is at on the
+  // registered parameters that were last set by a morph
+  void updateParameters() {
+    applying() = this;
+    for (size_t i = 0; i < mParameters.size(); i++) {
+      if (!mFollowAudio[i]) continue;
+      float v = mCurrent[i].load(std::memory_order_relaxed);
+      if (mParameters[i]->get() != v) mParameters[i]->set(v);
+    }
+    applying() = nullptr;
+  }
+
+  // Audio thread: call at the start of every block
+  void process(unsigned frames, double sampleRate) {
+    // finish the previous block
+    for (int i = 0; i < mCount; i++) {
+      uint32_t done = std::min(mRemaining[i], mFrames);
+      mValue[i] += mStep[i] * done;
+      mRemaining[i] -= done;
+      if (mRemaining[i] == 0) mValue[i] = mGoal[i];
+    }
+    mFrames = frames;
+
+    if (mCommands.update()) {
+      const Command& c = mCommands.latest();
+      mCount = c.count;
+      for (int i = 0; i < mCount; i++) {
+        if (c.serial[i] == mSerial[i]) continue;  // ramp unchanged
+        mSerial[i] = c.serial[i];
+        mGoal[i] = c.target[i];
+        mRemaining[i] = std::max(1u, uint32_t(c.seconds[i] * sampleRate));
+        mStep[i] = (mGoal[i] - mValue[i]) / mRemaining[i];
+      }
+    }
+    for (int i = 0; i < mCount; i++) {
+      mCurrent[i].store(mValue[i], std::memory_order_relaxed);
+    }
+  }
+
+  // Audio thread: value of parameter i at frame of the current block
+  float value(int i, unsigned frame = 0) const {
+    return frame >= mRemaining[i] ? mGoal[i] : mValue[i] + mStep[i] * frame;
+  }
+
+  // Audio thread: true while parameter i is ramping
+  bool morphing(int i) const { return mRemaining[i] > 0; }
+
+private:
+  struct Command {
+    int count = 0;
+    float target[MAX_PARAMETERS] = {0};
+    float seconds[MAX_PARAMETERS] = {0};
+    uint32_t serial[MAX_PARAMETERS] = {0};  // changes when a ramp restarts
+  };
+
+  // The morph whose updateParameters() runs on the calling thread. Per
+  // thread, so changes made meanwhile on other threads (OSC, presets) are
+  // not mistaken for it.
+  static const PresetMorph*& applying() {
+    static thread_local const PresetMorph* morph = nullptr;
+    return morph;
+  }
+
+  void setTarget(int i, float value, float seconds) {
+    mCommand.target[i] = value;
+    mCommand.seconds[i] = seconds;
+    mCommand.serial[i]++;
+  }
+
+  // control side
+  std::vector<al::Parameter*> mParameters;
+  std::map<int, std::vector<float>> mPresets;
+  float mSmoothing = 0.02f;
+  bool mFollowAudio[MAX_PARAMETERS] = {false};
+  std::mutex mSendMutex;  // parameters can change on several threads
+  Command mCommand;
+
+  TripleBuffer<Command> mCommands;
+
+  // audio thread
+  int mCount = 0;
+  unsigned mFrames = 0;
+  float mValue[MAX_PARAMETERS] = {0};  // at the start of the block
+  float mGoal[MAX_PARAMETERS] = {0};
+  float mStep[MAX_PARAMETERS] = {0};
+  uint32_t mRemaining[MAX_PARAMETERS] = {0};
+  uint32_t mSerial[MAX_PARAMETERS] = {0};
+
+  std::atomic<float> mCurrent[MAX_PARAMETERS];
+};
+
+#endif
@@ -28,7 +28,8 @@ struct MyApp : App {
   // prepare graphic elements for render. The main difference between
   // onAnimate() and onDraw() is that onAnimate() is called once per frame,
   // while onDraw() might be called more than once, for example for stereo
-  // rendering.
+  // rendering. Heavy scene traversal belongs here: see
+  // tutorials/interaction-sequencing/13_draw_list.cpp.
   void onAnimate(double dt) override {
     std::cout << "onAnimate() dt = " << dt << std::endl;
     value += 0.003f;
@@ -11,6 +11,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 using namespace al;
 
 // This example shows how to use SynthVoice and SynthManager to create an audio
@@ -115,7 +117,7 @@ public:
 
     // Play example sequence. Comment this line to start from scratch
     // synthManager.synthSequencer().playSequence("synth1.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   // The audio callback function. Called when audio hardware requires data
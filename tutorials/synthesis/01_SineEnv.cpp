@@ -12,6 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 
@@ -128,7 +130,7 @@ class MyApp : public App {
 
     // Play example sequence. Comment this line to start from scratch
     synthManager.synthSequencer().playSequence("synth1.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   // The audio callback function. Called when audio hardware requires data
@@ -15,6 +15,9 @@
 #include "al/graphics/al_Shapes.hpp"
 #include "al/graphics/al_Font.hpp"
 
+#include "TextBatch.hpp"
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 
@@ -217,8 +220,10 @@ class MyApp : public App {
                                     "Q","W","E","R","T","Y","U","I","O","P"};
   std::string blackkeyLabels[20] = {"S","D","","G","H","J","","L",";","",
                                     "2","3","","5","6","7","","9","0",""};
-  // Font renderder
-  FontRenderer fontRender;
+  // Font and the labels of all keys, laid out once and drawn in one call
+  Font font;
+  bool fontLoaded = false;
+  TextBatch keyLabels{font};
 
   // This function is called right after the window is created
   // It provides a grphics context to initialize ParameterGUI
@@ -243,12 +248,13 @@ class MyApp : public App {
     // Create a mesh that will be drawn as piano keys
     addRect(meshKey, 0, 0, keyWidth, keyHeight);
 
-    // Set the font renderer
-    fontRender.load(Font::defaultFont().c_str(), 60, 1024);
+    // Load the font and lay out the key labels
+    fontLoaded = font.load(Font::defaultFont().c_str(), 60, 1024);
+    updateKeyLabels();
 
     // Play example sequence. Comment this line to start from scratch
     synthManager.synthSequencer().playSequence("synth1.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   // The audio callback function. Called when audio hardware requires data
@@ -288,10 +294,6 @@ class MyApp : public App {
       g.color(c);
       g.tint(c);
       g.draw(meshKey);
-      
-      g.tint(1);
-      fontRender.write(whitekeyLabels[i].c_str(), fontSize);
-      fontRender.renderAt(g, {keyWidth * 0.5 - 5, keyHeight * 0.1, 0.0});
 
       g.popMatrix();
     }
@@ -316,16 +318,14 @@ class MyApp : public App {
       g.color(c);
       g.tint(c);
       g.draw(meshKey);
-      
-      g.scale(1, 2);
-      
-      g.tint(1);
-      fontRender.write(blackkeyLabels[i].c_str(), fontSize);
-      fontRender.renderAt(g, {keyWidth * 0.5 - 5, keyHeight * 0.1, 0.0});
-      
+
       g.popMatrix();
     }
 
+    // Drawing all key labels at once
+    g.tint(1);
+    keyLabels.draw(g);
+
     // Render the synth's graphics
     synthManager.render(g);
 
@@ -333,6 +333,25 @@ class MyApp : public App {
     imguiDraw();
   }
 
+  // Place the labels at the bottom of each key. Only needed when the keys
+  // change size, not every frame.
+  void updateKeyLabels() {
+    keyLabels.clear();
+    if (!fontLoaded) {
+      return;
+    }
+    for (int i = 0; i < 20; i++) {
+      int index = i % 10;
+      float x = (keyWidth + keyPadding * 2) * index + keyPadding;
+      float y = i >= 10 ? keyHeight + keyPadding * 2 : 0;
+      keyLabels.add(whitekeyLabels[i], fontSize, x + keyWidth * 0.5 - 5,
+                    y + keyHeight * 0.1);
+      if (index == 2 || index == 6 || index == 9) continue;
+      keyLabels.add(blackkeyLabels[i], fontSize, x + keyWidth - 5,
+                    y + keyHeight * 0.6);
+    }
+  }
+
   // Whenever a key is pressed, this function is called
   bool onKeyDown(Keyboard const& k) override {
     if (ParameterGUI::usingKeyboard()) {  // Ignore keys if GUI is using
@@ -402,6 +421,8 @@ class MyApp : public App {
     keyHeight = h / 2.f - keyPadding * 2.f;
     fontSize = keyWidth * 0.2;
     addRect(meshKey, 0, 0, keyWidth, keyHeight);
+    keyLabels.clearCache();  // layouts of the old size are not needed
+    updateKeyLabels();
   }
 
   void onExit() override { imguiShutdown(); }
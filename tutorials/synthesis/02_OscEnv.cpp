@@ -11,6 +11,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 
@@ -181,7 +183,7 @@ class MyApp : public App {
 
     // Play example sequence. Comment this line to start from scratch
     synthManager.synthSequencer().playSequence("synth2.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   void onSound(AudioIOData& io) override {
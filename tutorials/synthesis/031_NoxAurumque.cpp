@@ -12,6 +12,9 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "RtLog.hpp"
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 
@@ -173,8 +176,9 @@ public:
     //   secondsModTwelve -= 15.0;
     // }
 
-    std::cout << "frequency at onProcess: " << frequency << std::endl;
-    std::cout << "placement at onProcess: " << placement << std::endl;
+    // Printed from a background thread, see RtLog.hpp
+    RTLOG_DEBUG("frequency at onProcess: {}", frequency);
+    RTLOG_DEBUG("placement at onProcess: {}", placement);
 
     g.pushMatrix();
     // g.translate((rand()%100-50)/40.0, (frequency - C5)/275, -6.8 - timer.elapsedSec()/9.5);
@@ -231,7 +235,7 @@ public:
 
     // Play example sequence. Comment this line to start from scratch
     // synthManager.synthSequencer().playSequence("synth1.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   // The audio callback function. Called when audio hardware requires data
@@ -375,7 +379,7 @@ public:
     // newTime = newTime/2.0 - 1;
     // std::cout << newTime << std::endl;
     amp /= 2;
-    std::cout << "placement at playNote: " << time << std::endl;
+    RTLOG_DEBUG("placement at playNote: {}", time);
     // std::cout << pos() << std::endl;
     voice->setTriggerParams({amp*gain, freq, attack, decay, 0.0, 0.5, time});
     synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
@@ -12,6 +12,9 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "RtLog.hpp"
+#include "TriggerEventLog.hpp"
+
 using namespace al;
 
 Timer timer;
@@ -132,15 +135,12 @@ public:
 
   void onTriggerOn() override { 
     mAmpEnv.reset(); 
-    std::cout << "TRIGGER ON!!!" << std::endl;
-    float f = getInternalParameterValue("frequency");
-    std::cout << f << std::endl;
+    // Printed from a background thread, see RtLog.hpp
+    RTLOG_DEBUG("TRIGGER ON!!! {}", getInternalParameterValue("frequency"));
     }
 
   void onTriggerOff() override { 
-    std::cout << "trigger off." << std::endl;
-    float f = getInternalParameterValue("frequency");
-    std::cout << f << std::endl;
+    RTLOG_DEBUG("trigger off. {}", getInternalParameterValue("frequency"));
     mAmpEnv.release(); 
     }
 };
@@ -158,11 +158,19 @@ public:
 
     imguiInit();
 
-    synthManager.synthRecorder().verbose(true);
+    // Start the log's writer thread here rather than from the first note,
+    // which is triggered on the audio thread
+    RtLog::instance();
+
+    printTriggerEvents(synthManager.synth());
   }
 
   void onSound(AudioIOData &io) override
   {
+    // The voices log from their trigger callbacks, which run here. Take the
+    // audio thread's ring before they do; this does nothing after the first
+    // call.
+    RtLog::instance().prepareThread();
     synthManager.render(io);
   }
 
@@ -12,6 +12,9 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TimingWheel.hpp"
+#include "TriggerEventLog.hpp"
+
 using namespace al;
 
 Timer timer;
@@ -95,6 +98,9 @@ class MyApp : public App
 {
 public:
   SynthGUIManager<SquareWave> synthManager{"SquareWave"};
+  // Notes are started from onDraw(); the scheduler hands them to the audio
+  // thread without locking
+  VoiceScheduler scheduler;
 
   Mesh mMesh;
 
@@ -103,16 +109,18 @@ public:
     navControl().active(false); 
 
     gam::sampleRate(audioIO().framesPerSecond());
+    scheduler.sampleRate(audioIO().framesPerSecond());
 
     imguiInit();
 
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
 
     addSphere(mMesh, 1.0);
   }
 
   void onSound(AudioIOData &io) override
   {
+    scheduler.render(synthManager.synth(), io);
     synthManager.render(io);
   }
 
@@ -190,8 +198,8 @@ public:
     SquareWave *voice = synthManager.synth().getVoice<SquareWave>();
     // amp, freq, attack, release, pan
     const float gain = 0.5f;
-    voice->setTriggerParams({amp*gain, freq, attack, decay, 0.0, 0.5, time});
-    synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+    scheduler.addVoiceFromNow(voice, time, duration,
+                              {amp*gain, freq, attack, decay, 0.0, 0.5, time});
   }
 };
 
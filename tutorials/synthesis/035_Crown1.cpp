@@ -12,6 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 using namespace al;
 
 Timer timer;
@@ -171,7 +173,7 @@ public:
 
     imguiInit();
 
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
 
     addSphere(mMesh, 1.0);
   }
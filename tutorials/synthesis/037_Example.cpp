@@ -12,6 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 using namespace al;
 
 struct Piece {
@@ -103,7 +105,7 @@ public:
 
     imguiInit();
 
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
 
     // addSphere(mMesh, 1.0);
   }
@@ -12,6 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 
@@ -197,7 +199,7 @@ class MyApp : public App {
 
     // Play example sequence. Comment this line to start from scratch
 //    synthManager.synthSequencer().playSequence("synth3.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   void onSound(AudioIOData& io) override {
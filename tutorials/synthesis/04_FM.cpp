@@ -12,6 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 using namespace std;
@@ -134,7 +136,7 @@ class MyApp : public App {
 
     // Play example sequence. Comment this line to start from scratch
     //    synthManager.synthSequencer().playSequence("synth4.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
   }
 
   void onSound(AudioIOData& io) override {
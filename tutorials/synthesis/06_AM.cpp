@@ -13,6 +13,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "TriggerEventLog.hpp"
+
 using namespace gam;
 using namespace al;
 using namespace std;
@@ -165,7 +167,7 @@ public:
     void onCreate() override {
         // Play example sequence. Comment this line to start from scratch
         //    synthManager.synthSequencer().playSequence("synth2.synthSequence");
-        synthManager.synthRecorder().verbose(true);
+        printTriggerEvents(synthManager.synth());
     }
 
     void onSound(AudioIOData& io) override {
@@ -13,6 +13,10 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "AudioAnalyzer.hpp"
+#include "MidiQueue.hpp"
+#include "TriggerEventLog.hpp"
+
 using namespace gam;
 using namespace al;
 using namespace std;
@@ -93,6 +97,10 @@ public:
     
   }
 
+  // Audio thread: release the note at frame `offset` of the current block,
+  // instead of at the start of it. Call before the synth renders the block.
+  void releaseAt(int offset) { mReleaseFrame = offset; }
+
   virtual void onProcess(AudioIOData& io) override {
     // Parameters will update values once per audio callback
     float freq = getInternalParameterValue("frequency");
@@ -150,6 +158,10 @@ public:
     }
 
     while(io()){
+      if (mReleaseFrame >= 0 && int(io.frame()) >= mReleaseFrame) {
+        release();
+        mReleaseFrame = -1;
+      }
       float s1 = (mOsc1() + mOsc2() + mOsc3()) * mEnvStri() * ampStri;
       s1 += (mOsc4() + mOsc5()) * mEnvLow() * ampLow;
       s1 += (mOsc6() + mOsc7() + mOsc8() + mOsc9()) * mEnvUp() * ampUp;
@@ -192,13 +204,22 @@ public:
     mEnvStri.reset();
     mEnvLow.reset();
     mEnvUp.reset();
+    mReleaseFrame = -1;
   }
 
   virtual void onTriggerOff() override {
+    // A release set with releaseAt() happens in onProcess()
+    if (mReleaseFrame < 0) release();
+  }
+
+private:
+  void release() {
     mEnvStri.triggerRelease();
     mEnvLow.triggerRelease();
     mEnvUp.triggerRelease();
   }
+
+  int mReleaseFrame = -1;
 };
 
 class MyApp : public App, MIDIMessageHandler {
@@ -210,7 +231,22 @@ public:
   float waveformData[BLOCK_SIZE * CHANNEL_COUNT]{0};
   Mesh waveformMesh[2]{Mesh::LINE_STRIP, Mesh::LINE_STRIP};
 
+  // Spectrum and onsets are computed on the analyzer's thread, the audio
+  // callback only hands it the output
+  AudioAnalyzer analyzer;
+  AudioAnalyzer::Result analysis;
+  Mesh spectrumMesh[2]{Mesh::LINE_STRIP, Mesh::LINE_STRIP};
+  uint64_t lastOnsets = 0;
+  float flash = 0;
+
   RtMidiIn midiIn;
+  // MIDI messages are timestamped on arrival and applied by the audio
+  // thread at the sample they were played
+  MidiQueue midiQueue;
+  // Voices for MIDI notes, taken from the synth outside the audio thread
+  ReadyVoices<AddSyn> readyVoices;
+  // Audio thread: the voice playing each note
+  AddSyn* noteVoices[128]{};
 
   virtual void onInit( ) override {
     imguiInit();
@@ -219,6 +255,12 @@ public:
     // Set sampling rate for Gamma objects from app's audio
     gam::sampleRate(audioIO().framesPerSecond());
 
+    // Start the analysis before audio starts pushing to it
+    AudioAnalyzer::Settings settings;
+    settings.channels = CHANNEL_COUNT;
+    settings.sampleRate = SAMPLE_RATE;
+    analyzer.start(settings);
+
     // Check for connected MIDI devices
     if (midiIn.getPortCount() > 0) {
       // Bind ourself to the RtMidiIn object, to have the onMidiMessage()
@@ -238,7 +280,9 @@ public:
   void onCreate() override {
     // Play example sequence. Comment this line to start from scratch
     //    synthManager.synthSequencer().playSequence("synth7.synthSequence");
-    synthManager.synthRecorder().verbose(true);
+    printTriggerEvents(synthManager.synth());
+    // Voices for MIDI notes are taken on the audio thread, have them ready
+    readyVoices.fill(synthManager.synth());
 
     hueMapping.setElements(mappingType);
     satMapping.setElements(mappingType);
@@ -246,12 +290,17 @@ public:
   }
 
   void onSound(AudioIOData& io) override {
+    midiQueue.process(io, [&](const MIDIMessage& m, int offset) {
+      applyMIDIMessage(m, offset);
+    });
     synthManager.render(io);  // Render audio
 
     memcpy(&waveformData, io.outBuffer(), BLOCK_SIZE * CHANNEL_COUNT * sizeof(float));
+    analyzer.push(io);  // Only copies the block, analysis runs elsewhere
   }
 
   void onAnimate(double dt) override {
+    readyVoices.fill(synthManager.synth());  // replace the voices played
     imguiBeginFrame();
     synthManager.drawSynthControlPanel();
 
@@ -282,7 +331,28 @@ public:
         float y = hSegment * ((waveformData[ch * BLOCK_SIZE + i] + 1)/ 2.0) + yBase;
         
         waveformMesh[ch].vertex(x, y);
-        waveformMesh[ch].color(HSV(hue, sat, val));
+        waveformMesh[ch].color(HSV(hue, sat, std::min(1.0f, val + flash)));
+      }
+    }
+
+    // Spectrum on a log frequency axis, flash on onsets
+    analyzer.latest(analysis);
+    if (analysis.onsets != lastOnsets) {
+      lastOnsets = analysis.onsets;
+      flash = 1.0f;
+    }
+    flash *= 0.9f;
+    float logMin = log(20.0f), logMax = log(SAMPLE_RATE / 2);
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+      spectrumMesh[ch].reset();
+      float yBase = (CHANNEL_COUNT - ch - 1) * hSegment;
+      auto &mag = analysis.spectrum[ch];
+      for (size_t k = 1; k < mag.size(); k++) {
+        float x =
+            w * (log(analyzer.binFrequency(k)) - logMin) / (logMax - logMin);
+        float y = yBase + hSegment * std::min(1.0f, 20 * mag[k]);
+        spectrumMesh[ch].vertex(x, y);
+        spectrumMesh[ch].color(HSV(hue + 0.5f, sat, 0.6f));
       }
     }
   }
@@ -296,6 +366,7 @@ public:
     g.meshColor();
     for(int ch = 0; ch < CHANNEL_COUNT; ch++) { 
       g.draw(waveformMesh[ch]);
+      g.draw(spectrumMesh[ch]);
     }
 
     // Draw GUI
@@ -330,23 +401,47 @@ public:
     return true;
   }
 
-  void onExit() override { imguiShutdown(); }
+  void onExit() override {
+    analyzer.stop();
+    imguiShutdown();
+  }
 
-  // This gets called whenever a MIDI message is received on the port
+  // This gets called whenever a MIDI message is received on the port. It
+  // runs on RtMidi's thread, so only queue the message for the audio thread.
   void onMIDIMessage(const MIDIMessage& m) {
-    printf("%s: ", MIDIByte::messageTypeString(m.status()));
+    printf("%s\n", MIDIByte::messageTypeString(m.status()));
+    midiQueue.push(m);
+  }
 
+  // Called by the audio thread, offset is the frame in the current block
+  void applyMIDIMessage(const MIDIMessage& m, int offset) {
     // Here we demonstrate how to parse common channel messages
     switch (m.type()) {
-    case MIDIByte::NOTE_ON:
-      synthManager.voice()->setInternalParameterValue(
+    case MIDIByte::NOTE_ON: {
+      // Same as synthManager.triggerOn(), but starting at offset. The note
+      // is dropped if onAnimate() has not replaced the voices played yet.
+      AddSyn* voice = readyVoices.take();
+      if (!voice) break;
+      float params[64];
+      int count = synthManager.voice()->getTriggerParams(params, 64);
+      voice->setTriggerParams(params, count);
+      voice->setInternalParameterValue(
           "frequency", ::pow(2.f, (m.noteNumber() - 69.f) / 12.f) * 432.f);
-      synthManager.triggerOn(m.noteNumber());
+      synthManager.synth().triggerOn(voice, offset, m.noteNumber());
+      noteVoices[m.noteNumber()] = voice;
       break;
+    }
 
     case MIDIByte::NOTE_OFF:
       if (m.noteNumber() > 0) {
-        synthManager.triggerOff(m.noteNumber());
+        // Release at offset, the synth's triggerOff() would release at the
+        // start of the block
+        AddSyn* voice = noteVoices[m.noteNumber()];
+        if (voice && voice->active() && voice->id() == m.noteNumber()) {
+          voice->releaseAt(offset);
+        }
+        noteVoices[m.noteNumber()] = nullptr;
+        synthManager.synth().triggerOff(m.noteNumber());
       }
       break;
     default:;
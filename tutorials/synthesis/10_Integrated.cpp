@@ -12,6 +12,11 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "RtLog.hpp"
+#include "TimingWheel.hpp"
+#include "VoiceTelemetry.hpp"
+#include "TriggerEventLog.hpp"
+
 // using namespace gam;
 using namespace al;
 using namespace std;
@@ -19,6 +24,15 @@ using namespace std;
 gam::ArrayPow2<float>
     tbSaw(2048), tbSqr(2048), tbImp(2048), tbSin(2048), tbPls(2048), tbDin(2048),
     tb__1(2048), tb__2(2048), tb__3(2048), tb__4(2048);
+
+// Values the audio callbacks pass to the graphics callbacks. The two run on
+// different threads, so the values are published once per block through a
+// VoiceTelemetry instead of being read from the voice's members.
+struct VoiceFeatures {
+  float level;  // envelope follower output
+  float vib;    // vibrato oscillator
+};
+
 class OscEnv : public SynthVoice {
  public:
   // Unit generators
@@ -27,6 +41,7 @@ class OscEnv : public SynthVoice {
   gam::ADSR<> mAmpEnv;
   gam::EnvFollow<>
       mEnvFollow;  // envelope follower to connect audio output to graphics
+  VoiceTelemetry<VoiceFeatures> mTelemetry;
 
   // Additional members
   Mesh mMesh;
@@ -67,16 +82,18 @@ class OscEnv : public SynthVoice {
     // We need to let the synth know that this voice is done
     // by calling the free(). This takes the voice out of the
     // rendering chain
+    mTelemetry.publish({mEnvFollow.value(), 0});
     if (mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
   }
 
   void onProcess(Graphics& g) override {
+    VoiceFeatures features = mTelemetry.latest();
     float frequency = getInternalParameterValue("frequency");
     float amplitude = getInternalParameterValue("amplitude");
     g.pushMatrix();
     g.translate(amplitude+frequency/2000, amplitude/2+frequency/2000, -4);
     g.scale(0.1, 0.1, 0.1);
-    g.color(mEnvFollow.value(), frequency / 2000, mEnvFollow.value() * 10, 0.6);
+    g.color(features.level, frequency / 2000, features.level * 10, 0.6);
     g.draw(mMesh);
     g.popMatrix();
   }
@@ -139,6 +156,7 @@ class Vib : public SynthVoice {
   gam::ADSR<> mAmpEnv;
   gam::ADSR<> mVibEnv;
   gam::EnvFollow<> mEnvFollow;
+  VoiceTelemetry<VoiceFeatures> mTelemetry;
 
   float vibValue;
 
@@ -183,17 +201,19 @@ class Vib : public SynthVoice {
       io.out(1) += s2;
     }
     // if(mAmpEnv.done()) free();
+    mTelemetry.publish({mEnvFollow.value(), vibValue});
     if (mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
   }
 
   void onProcess(Graphics& g) override {
+    VoiceFeatures features = mTelemetry.latest();
     float frequency = getInternalParameterValue("frequency");
     float amplitude = getInternalParameterValue("amplitude");
     g.pushMatrix();
     g.translate(amplitude, amplitude, -4);
-    float scaling = vibValue + getInternalParameterValue("vibDepth");
+    float scaling = features.vib + getInternalParameterValue("vibDepth");
     g.scale(scaling * frequency / 200, scaling * frequency / 400, scaling * 1);
-    g.color(mEnvFollow.value(), frequency / 1000, mEnvFollow.value() * 10, 0.4);
+    g.color(features.level, frequency / 1000, features.level * 10, 0.4);
     g.draw(mMesh);
     g.popMatrix();
   }
@@ -266,6 +286,7 @@ class FM : public SynthVoice {
   gam::ADSR<> mAmpEnv;
   gam::ADSR<> mModEnv;
   gam::EnvFollow<> mEnvFollow;
+  VoiceTelemetry<VoiceFeatures> mTelemetry;
   gam::ADSR<> mVibEnv;
 
   gam::Sine<> car, mod, mVib;  // carrier, modulator sine oscillators
@@ -331,10 +352,12 @@ class FM : public SynthVoice {
       io.out(0) += s1;
       io.out(1) += s2;
     }
+    mTelemetry.publish({mEnvFollow.value(), 0});
     if (mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
   }
 
   void onProcess(Graphics& g) override {
+    VoiceFeatures features = mTelemetry.latest();
     g.pushMatrix();
     g.translate(getInternalParameterValue("frequency") / 300 - 2,
                 (getInternalParameterValue("idx3") +
@@ -345,7 +368,7 @@ class FM : public SynthVoice {
     float scaling = getInternalParameterValue("amplitude") / 3;
     g.scale(scaling, scaling, scaling * 1);
     g.color(HSV(getInternalParameterValue("modMul") / 20, 1,
-                mEnvFollow.value() * 10));
+                features.level * 10));
     g.draw(mMesh);
     g.popMatrix();
   }
@@ -407,6 +430,7 @@ public:
     //gam::Env<2> mTrmEnv;
     gam::ADSR<> mAmpEnv;
     gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    VoiceTelemetry<VoiceFeatures> mTelemetry;
 
     // Additional members
     Mesh mMesh;
@@ -460,10 +484,12 @@ public:
         // We need to let the synth know that this voice is done
         // by calling the free(). This takes the voice out of the
         // rendering chain
+        mTelemetry.publish({mEnvFollow.value(), 0});
         if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
     }
 
     virtual void onProcess(Graphics &g) {
+            VoiceFeatures features = mTelemetry.latest();
             float frequency = getInternalParameterValue("frequency");
             float amplitude = getInternalParameterValue("amplitude");
             g.pushMatrix();
@@ -471,7 +497,7 @@ public:
             //g.scale(frequency/2000, frequency/4000, 1);
             float scaling = getInternalParameterValue("trmDepth");
             g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-            g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+            g.color(features.level, frequency/1000, features.level* 10, 0.4);
             g.draw(mMesh);
             g.popMatrix();
      }
@@ -529,6 +555,7 @@ public:
   gam::Sine<> mOsc;
   gam::ADSR<> mAmpEnv;
   gam::EnvFollow<> mEnvFollow;
+  VoiceTelemetry<VoiceFeatures> mTelemetry;
   gam::Pan<> mPan;
 
   Mesh mMesh;
@@ -582,10 +609,12 @@ public:
     // We need to let the synth know that this voice is done
     // by calling the free(). This takes the voice out of the
     // rendering chain
+    mTelemetry.publish({mEnvFollow.value(), 0});
     if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
   }
 
   virtual void onProcess(Graphics &g) {
+          VoiceFeatures features = mTelemetry.latest();
           float frequency = getInternalParameterValue("frequency");
           float amplitude = getInternalParameterValue("amplitude");
           g.pushMatrix();
@@ -593,7 +622,7 @@ public:
           //g.scale(frequency/2000, frequency/4000, 1);
           float scaling = 0.1;
           g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-          g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+          g.color(features.level, frequency/1000, features.level* 10, 0.4);
           g.draw(mMesh);
           g.popMatrix();
   }
@@ -651,6 +680,7 @@ public:
   gam::ADSR<> mEnvUp;
   gam::Pan<> mPan;
   gam::EnvFollow<> mEnvFollow;
+  VoiceTelemetry<VoiceFeatures> mTelemetry;
 
   // Additional members
   Mesh mMesh;
@@ -730,10 +760,12 @@ public:
       io.out(1) += s2;
     }
     //if(mEnvStri.done()) free();
+    mTelemetry.publish({mEnvFollow.value(), 0});
     if(mEnvStri.done() && mEnvUp.done() && mEnvLow.done() && (mEnvFollow.value() < 0.001)) free();
   }
 
   virtual void onProcess(Graphics &g) {
+          VoiceFeatures features = mTelemetry.latest();
           float frequency = getInternalParameterValue("frequency");
           float amplitude = getInternalParameterValue("amplitude");
           g.pushMatrix();
@@ -741,7 +773,7 @@ public:
           //g.scale(frequency/2000, frequency/4000, 1);
           float scaling = 0.1;
           g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-          g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+          g.color(features.level, frequency/1000, features.level* 10, 0.4);
           g.draw(mMesh);
           g.popMatrix();
   }
@@ -788,6 +820,7 @@ public:
     gam::Pan<> mPan;
     gam::ADSR<> mAmpEnv;
     gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    VoiceTelemetry<VoiceFeatures> mTelemetry;
     gam::DSF<> mOsc;
     gam::NoiseWhite<> mNoise;
     gam::Reson<> mRes;
@@ -851,10 +884,12 @@ public:
         }
         
         
+        mTelemetry.publish({mEnvFollow.value(), 0});
         if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
     }
 
    virtual void onProcess(Graphics &g) {
+          VoiceFeatures features = mTelemetry.latest();
           float frequency = getInternalParameterValue("frequency");
           float amplitude = getInternalParameterValue("amplitude");
           g.pushMatrix();
@@ -862,7 +897,7 @@ public:
           //g.scale(frequency/2000, frequency/4000, 1);
           float scaling = 0.1;
           g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-          g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+          g.color(features.level, frequency/1000, features.level* 10, 0.4);
           g.draw(mMesh);
           g.popMatrix();
    }
@@ -923,6 +958,7 @@ public:
     gam::Delay<float, gam::ipl::Trunc> delay;
     gam::ADSR<> mAmpEnv;
     gam::EnvFollow<> mEnvFollow;
+    VoiceTelemetry<VoiceFeatures> mTelemetry;
     gam::Env<2> mPanEnv;
 
     // Additional members
@@ -972,11 +1008,13 @@ public:
             io.out(0) += s1;
             io.out(1) += s2;
         }
+        mTelemetry.publish({mEnvFollow.value(), 0});
         if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
 
     }
 
     virtual void onProcess(Graphics &g) {
+          VoiceFeatures features = mTelemetry.latest();
           float frequency = getInternalParameterValue("frequency");
           float amplitude = getInternalParameterValue("amplitude");
           g.pushMatrix();
@@ -984,7 +1022,7 @@ public:
           //g.scale(frequency/2000, frequency/4000, 1);
           float scaling = 0.1;
           g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-          g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+          g.color(features.level, frequency/1000, features.level* 10, 0.4);
           g.draw(mMesh);
           g.popMatrix();
     }
@@ -1022,6 +1060,9 @@ class MyApp : public App
 {
     public:
     SynthGUIManager<OscTrm> synthManager {"integrated_inst"};
+    // fillTime() can schedule thousands of notes; a timing wheel keeps
+    // adding and triggering them cheap
+    VoiceScheduler scheduler;
     //    ParameterMIDI parameterMIDI;
     int midiNote;
     //    ParameterMIDI parameterMIDI;
@@ -1035,6 +1076,7 @@ class MyApp : public App
                                  // will be using keyboard for note triggering
         // Set sampling rate for Gamma objects from app's audio
         gam::sampleRate(audioIO().framesPerSecond());
+        scheduler.sampleRate(audioIO().framesPerSecond());
         // Additive Synth Related
         initScaleToHarmonicSeries();
         initScaleTo12TET(110);
@@ -1078,7 +1120,7 @@ class MyApp : public App
     void onCreate() override {
         // Play example sequence. Comment this line to start from scratch
         //    synthManager.synthSequencer().playSequence("synth2.synthSequence");
-        synthManager.synthRecorder().verbose(true);
+        printTriggerEvents(synthManager.synth());
         // Add another class used
         synthManager.synth().registerSynthClass<OscEnv>();
         synthManager.synth().registerSynthClass<Vib>();
@@ -1093,6 +1135,7 @@ class MyApp : public App
     }
 
     void onSound(AudioIOData& io) override {
+        scheduler.render(synthManager.synth(), io);  // Start scheduled notes
         synthManager.render(io);  // Render audio
     }
 
@@ -1170,11 +1213,13 @@ class MyApp : public App
         while (from <= to) {
             float nextAtt = gam::rnd::uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
             auto *voice = synthManager.synth().getVoice<AddSyn>();
-            voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0});
+            // Parameters travel inline with the event and are set when it
+            // plays, no vector per note
+            VoiceScheduler::Params params{0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0};
+            params.set(1, gam::rnd::uni(minFreq,maxFreq)); // frequency
             voice->setInternalParameterValue("attackStr", nextAtt);
-            voice->setInternalParameterValue("frequency", gam::rnd::uni(minFreq,maxFreq));
-            synthManager.synthSequencer().addVoiceFromNow(voice, from, 0.2);
-            std::cout << "old from " << from << " plus nextnextAtt " << nextAtt << std::endl;
+            scheduler.addVoiceFromNow(voice, from, 0.2, params);
+            RTLOG_DEBUG("old from {} plus nextnextAtt {}", from, nextAtt);
             from += nextAtt;
         }
   }
@@ -1184,11 +1229,11 @@ class MyApp : public App
 
         float nextAtt = gam::rnd::uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
         auto *voice = synthManager.synth().getVoice<AddSyn>();
-        voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0});
+        VoiceScheduler::Params params{0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0};
+        params.set(1, randomFrom12TET()); // frequency
         voice->setInternalParameterValue("attackStr", nextAtt);
-        voice->setInternalParameterValue("frequency", randomFrom12TET());
-        synthManager.synthSequencer().addVoiceFromNow(voice, from, 0.2);
-        std::cout << "12 old from " << from << " plus nextAtt " << nextAtt << std::endl;
+        scheduler.addVoiceFromNow(voice, from, 0.2, params);
+        RTLOG_DEBUG("12 old from {} plus nextAtt {}", from, nextAtt);
         from += nextAtt;
       }
   }
@@ -0,0 +1,289 @@
+#pragma once
+#ifndef AudioAnalyzer_H
+#define AudioAnalyzer_H
+
+/*
+Spectrum, level and onset analysis of an audio bus for visuals.
+
+Computing spectra in onSound() makes the audio callback longer and risks
+dropouts; computing them in onAnimate() needs the samples on the graphics
+thread. AudioAnalyzer does neither: the audio callback only copies its
+output into a lock-free ring buffer (push()), and a worker thread runs the
+analysis:
+
+- RMS and peak level of every channel
+- windowed FFT (STFT with a Hann window) magnitude of every channel
+- energy in logarithmically spaced bands
+- onset detection by spectral flux against an adaptive threshold
+
+onAnimate() copies the latest results with latest(). If the worker falls
+behind, audio blocks are dropped from the analysis, never delayed.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "al/io/al_AudioIOData.hpp"
+
+class AudioAnalyzer {
+public:
+  struct Settings {
+    int channels = 2;
+    float sampleRate = 44100;
+    int fftSize = 1024;   // power of two
+    int hopSize = 512;    // frames between analyses
+    int bands = 16;       // log spaced, from minFrequency to Nyquist
+    float minFrequency = 40;
+    float onsetSensitivity = 1.5;  // flux above this times the recent mean
+    float onsetMinInterval = 0.05; // seconds
+  };
+
+  struct Result {
+    std::vector<float> rms, peak;           // per channel
+    std::vector<std::vector<float>> spectrum;  // per channel, fftSize/2 + 1
+    std::vector<std::vector<float>> bands;     // per channel
+    float flux = 0;           // spectral flux of the latest frame
+    uint64_t onsets = 0;      // onsets detected since start()
+    uint64_t frames = 0;      // analysis frames since start()
+    uint64_t droppedBlocks = 0;
+  };
+
+  ~AudioAnalyzer() { stop(); }
+
+  void start(const Settings& settings) {
+    stop();
+    mSettings = settings;
+    mSettings.hopSize = std::max(1, std::min(settings.hopSize, settings.fftSize));
+    int channels = settings.channels;
+    int n = settings.fftSize;
+
+    // room for a quarter second of audio, rounded up to a power of two
+    mCapacity = 1;
+    while (mCapacity < size_t(settings.sampleRate / 4) + n) mCapacity <<= 1;
+    mRing.assign(channels, std::vector<float>(mCapacity, 0.0f));
+    mWrite = mRead = 0;
+    mDropped = 0;
+
+    mWindow.resize(n);
+    for (int i = 0; i < n; i++) {
+      mWindow[i] = 0.5f - 0.5f * std::cos(2 * M_PI * i / n);
+    }
+    mFrames.assign(channels, std::vector<float>(n, 0.0f));
+    mFFT.resize(n);
+    mPrevMagnitude.assign(channels, std::vector<float>(n / 2 + 1, 0.0f));
+    mBandEdges.clear();
+    for (int b = 0; b <= settings.bands; b++) {
+      float f = settings.minFrequency *
+                std::pow(settings.sampleRate / 2 / settings.minFrequency,
+                         float(b) / settings.bands);
+      mBandEdges.push_back(std::min(n / 2 + 1, int(f * n / settings.sampleRate)));
+    }
+    mFluxHistory.assign(int(0.5 * settings.sampleRate / settings.hopSize) + 1,
+                        0.0f);
+    mSinceOnset = 0;
+
+    Result r;
+    r.rms.assign(channels, 0);
+    r.peak.assign(channels, 0);
+    r.spectrum.assign(channels, std::vector<float>(n / 2 + 1, 0.0f));
+    r.bands.assign(channels, std::vector<float>(settings.bands, 0.0f));
+    mWorking = r;
+    {
+      std::lock_guard<std::mutex> lock(mResultMutex);
+      mResult = r;
+    }
+
+    mRunning = true;
+    mThread = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    if (mRunning.exchange(false)) mThread.join();
+  }
+
+  // Audio thread: queue the output of this block for analysis. Lock and
+  // allocation free.
+  void push(al::AudioIOData& io) {
+    int channels = std::min(int(mRing.size()), (int)io.channelsOut());
+    const float* buffers[64];
+    channels = std::min(channels, 64);
+    for (int c = 0; c < channels; c++) buffers[c] = io.outBuffer(c);
+    push(buffers, channels, io.framesPerBuffer());
+  }
+
+  void push(const float* const* channels, int channelCount, size_t frames) {
+    size_t w = mWrite.load(std::memory_order_relaxed);
+    size_t r = mRead.load(std::memory_order_acquire);
+    if (mCapacity - (w - r) < frames) {
+      mDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    for (size_t c = 0; c < mRing.size(); c++) {
+      float* ring = mRing[c].data();
+      for (size_t i = 0; i < frames; i++) {
+        ring[(w + i) & (mCapacity - 1)] =
+            int(c) < channelCount ? channels[c][i] : 0.0f;
+      }
+    }
+    mWrite.store(w + frames, std::memory_order_release);
+  }
+
+  // Graphics thread: copy the latest results. Returns false if nothing was
+  // analyzed since the last call.
+  bool latest(Result& out) {
+    std::lock_guard<std::mutex> lock(mResultMutex);
+    bool fresh = out.frames != mResult.frames;
+    out = mResult;
+    return fresh;
+  }
+
+  const Settings& settings() const { return mSettings; }
+
+  // Center frequency of spectrum bin k
+  float binFrequency(int k) const {
+    return k * mSettings.sampleRate / mSettings.fftSize;
+  }
+
+private:
+  void run() {
+    const size_t hop = size_t(mSettings.hopSize);
+    while (mRunning) {
+      size_t r = mRead.load(std::memory_order_relaxed);
+      size_t w = mWrite.load(std::memory_order_acquire);
+      if (w - r < hop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        continue;
+      }
+      // slide every channel's frame by one hop
+      for (size_t c = 0; c < mRing.size(); c++) {
+        std::vector<float>& frame = mFrames[c];
+        std::memmove(frame.data(), frame.data() + hop,
+                     (frame.size() - hop) * sizeof(float));
+        float* dest = frame.data() + frame.size() - hop;
+        for (size_t i = 0; i < hop; i++) {
+          dest[i] = mRing[c][(r + i) & (mCapacity - 1)];
+        }
+      }
+      mRead.store(r + hop, std::memory_order_release);
+      analyze();
+    }
+  }
+
+  void analyze() {
+    const int n = mSettings.fftSize;
+    const int hop = mSettings.hopSize;
+    Result& res = mWorking;
+    float flux = 0;
+
+    for (size_t c = 0; c < mFrames.size(); c++) {
+      const std::vector<float>& frame = mFrames[c];
+      // level of the newest hop
+      float sum = 0, peak = 0;
+      for (int i = n - hop; i < n; i++) {
+        sum += frame[i] * frame[i];
+        peak = std::max(peak, std::fabs(frame[i]));
+      }
+      res.rms[c] = std::sqrt(sum / hop);
+      res.peak[c] = peak;
+
+      for (int i = 0; i < n; i++) {
+        mFFT[i] = std::complex<float>(frame[i] * mWindow[i], 0);
+      }
+      fft(mFFT);
+
+      std::vector<float>& mag = res.spectrum[c];
+      std::vector<float>& prev = mPrevMagnitude[c];
+      for (int k = 0; k <= n / 2; k++) {
+        mag[k] = std::abs(mFFT[k]) * 4.0f / n;  // sine of amplitude 1 -> 1
+        float diff = std::log1p(100 * mag[k]) - std::log1p(100 * prev[k]);
+        if (diff > 0) flux += diff;
+        prev[k] = mag[k];
+      }
+      for (int b = 0; b < mSettings.bands; b++) {
+        // at least one bin per band
+        int end = std::min(std::max(mBandEdges[b + 1], mBandEdges[b] + 1),
+                           n / 2 + 1);
+        float e = 0;
+        for (int k = mBandEdges[b]; k < end; k++) e += mag[k] * mag[k];
+        res.bands[c][b] = std::sqrt(e);
+      }
+    }
+
+    // onset: flux well above its recent average, and a local rise
+    float mean = 0;
+    for (float f : mFluxHistory) mean += f;
+    mean /= mFluxHistory.size();
+    mSinceOnset += float(hop) / mSettings.sampleRate;
+    if (flux > mean * mSettings.onsetSensitivity + 0.5f &&
+        flux > res.flux && mSinceOnset > mSettings.onsetMinInterval) {
+      res.onsets++;
+      mSinceOnset = 0;
+    }
+    std::rotate(mFluxHistory.begin(), mFluxHistory.begin() + 1,
+                mFluxHistory.end());
+    mFluxHistory.back() = flux;
+    res.flux = flux;
+    res.frames++;
+    res.droppedBlocks = mDropped.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mResultMutex);
+    mResult = res;
+  }
+
+  // In place iterative radix-2 FFT
+  static void fft(std::vector<std::complex<float>>& a) {
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+      size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i < j) std::swap(a[i], a[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+      double angle = -2 * M_PI / len;
+      std::complex<float> wlen(std::cos(angle), std::sin(angle));
+      for (size_t i = 0; i < n; i += len) {
+        std::complex<float> w(1);
+        for (size_t j = 0; j < len / 2; j++) {
+          std::complex<float> u = a[i + j], v = a[i + j + len / 2] * w;
+          a[i + j] = u + v;
+          a[i + j + len / 2] = u - v;
+          w *= wlen;
+        }
+      }
+    }
+  }
+
+  Settings mSettings;
+
+  // ring buffer from the audio thread, one per channel
+  std::vector<std::vector<float>> mRing;
+  size_t mCapacity = 0;
+  std::atomic<size_t> mWrite{0}, mRead{0};
+  std::atomic<uint64_t> mDropped{0};
+
+  // worker state
+  std::vector<std::vector<float>> mFrames;
+  std::vector<float> mWindow;
+  std::vector<std::complex<float>> mFFT;
+  std::vector<std::vector<float>> mPrevMagnitude;
+  std::vector<int> mBandEdges;
+  std::vector<float> mFluxHistory;
+  float mSinceOnset = 0;
+  Result mWorking;
+
+  std::mutex mResultMutex;  // between the worker and the graphics thread
+  Result mResult;
+
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+};
+
+#endif
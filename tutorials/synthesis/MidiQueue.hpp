@@ -0,0 +1,202 @@
+#pragma once
+#ifndef MidiQueue_H
+#define MidiQueue_H
+
+/*
+Timestamped MIDI input for the audio thread.
+
+MIDIMessageHandler::onMIDIMessage() and ParameterMIDI run on RtMidi's
+thread. Triggering voices or setting parameters from there races with the
+audio callback, and whatever is changed takes effect at the start of the
+next block, so notes played live land on a grid of block boundaries
+(about 11 ms at 512 frames and 48 kHz) instead of where they were played.
+
+MidiQueue records the arrival time of each message and hands it to the
+audio thread through a wait-free single producer, single consumer ring.
+The audio callback maps arrival times to sample offsets with a constant
+latency of one block, so every message is applied the same time after it
+was played, at the sample it belongs to:
+
+  // MIDI thread
+  void onMIDIMessage(const MIDIMessage& m) { midiQueue.push(m); }
+
+  // audio thread, at the start of onSound()
+  midiQueue.process(io, [&](const MIDIMessage& m, int offset) { ... });
+
+or, to apply messages inside a per sample loop:
+
+  midiQueue.beginBlock(io);
+  while (io()) {
+    MIDIMessage m;
+    while (midiQueue.next(io.frame(), m)) { ... }
+    ...
+  }
+
+Voices for notes played live must not come from PolySynth::getVoice() on
+the audio thread: it locks the synth's free voice list and allocates a new
+voice when none is free. ReadyVoices takes them ahead of time on another
+thread, and the audio thread takes one per note:
+
+  // onCreate() and onAnimate()
+  readyVoices.fill(synth);
+  // audio thread, nullptr (note dropped) if none was ready
+  MyVoice* voice = readyVoices.take();
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/io/al_MIDI.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+class MidiQueue {
+public:
+  // MIDI thread: queue a message. Returns false, and drops the message, if
+  // the audio thread has not kept up.
+  bool push(const al::MIDIMessage& m) {
+    size_t w = mWrite.load(std::memory_order_relaxed);
+    if (w - mRead.load(std::memory_order_acquire) == CAPACITY) {
+      mDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Entry& e = mEntries[w & (CAPACITY - 1)];
+    e.arrival = seconds();
+    e.timeStamp = m.timeStamp();
+    e.port = m.port();
+    e.bytes[0] = m.bytes[0];
+    e.bytes[1] = m.bytes[1];
+    e.bytes[2] = m.bytes[2];
+    mWrite.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Audio thread: place this block on the arrival time line. Call once per
+  // block before next().
+  void beginBlock(al::AudioIOData& io) {
+    beginBlock(io.framesPerBuffer(), io.framesPerSecond());
+  }
+
+  void beginBlock(unsigned frames, double sampleRate) {
+    mFrames = frames;
+    mSampleRate = sampleRate;
+    double period = frames / sampleRate;
+    // the block that starts playing now covers messages that arrived during
+    // the previous block period
+    double measured = seconds() - period;
+    double expected = mBlockStart + period;
+    if (!mStarted || std::fabs(measured - expected) > 2 * period) {
+      // first block, or after a dropout or a change of block size
+      mBlockStart = measured;
+      mStarted = true;
+    } else {
+      // callbacks are not called at exact intervals; follow the average
+      mBlockStart = expected + 0.05 * (measured - expected);
+    }
+  }
+
+  // Audio thread: get the next message due at or before frame
+  bool next(unsigned frame, al::MIDIMessage& m) {
+    size_t r = mRead.load(std::memory_order_relaxed);
+    if (r == mWrite.load(std::memory_order_acquire)) return false;
+    const Entry& e = mEntries[r & (CAPACITY - 1)];
+    int offset = offsetOf(e);
+    if (offset >= int(mFrames) || offset > int(frame)) return false;
+    m = al::MIDIMessage(e.timeStamp, e.port, e.bytes[0], e.bytes[1],
+                        e.bytes[2]);
+    mRead.store(r + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Audio thread: call f(message, offset) for each message due in this
+  // block, offset being the frame within the block
+  template <class F>
+  void process(al::AudioIOData& io, F&& f) {
+    beginBlock(io);
+    al::MIDIMessage m(0, 0, 0);
+    size_t r = mRead.load(std::memory_order_relaxed);
+    while (r != mWrite.load(std::memory_order_acquire)) {
+      const Entry& e = mEntries[r & (CAPACITY - 1)];
+      int offset = offsetOf(e);
+      if (offset >= int(mFrames)) break;  // arrived during this block
+      m = al::MIDIMessage(e.timeStamp, e.port, e.bytes[0], e.bytes[1],
+                          e.bytes[2]);
+      mRead.store(++r, std::memory_order_release);
+      f(m, offset);
+    }
+  }
+
+  uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+  static const size_t CAPACITY = 1024;  // power of two
+
+  struct Entry {
+    double arrival;
+    double timeStamp;
+    unsigned port;
+    uint8_t bytes[3];
+  };
+
+  static double seconds() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int offsetOf(const Entry& e) const {
+    double offset = (e.arrival - mBlockStart) * mSampleRate;
+    return offset < 0 ? 0 : int(offset);  // late messages play first
+  }
+
+  Entry mEntries[CAPACITY];
+  std::atomic<size_t> mWrite{0}, mRead{0};
+  std::atomic<uint64_t> mDropped{0};
+
+  // audio thread
+  bool mStarted = false;
+  double mBlockStart = 0;
+  double mSampleRate = 44100;
+  unsigned mFrames = 0;
+};
+
+// Voices taken from a PolySynth by one thread and used by the audio thread,
+// through a single producer, single consumer ring
+template <class TVoice, size_t CAPACITY = 16>
+class ReadyVoices {
+public:
+  // Not the audio thread: take voices from synth until `count` are ready
+  void fill(al::PolySynth& synth, size_t count = CAPACITY) {
+    count = std::min(count, CAPACITY);
+    size_t w = mWrite.load(std::memory_order_relaxed);
+    while (w - mRead.load(std::memory_order_acquire) < count) {
+      mVoices[w % CAPACITY] = synth.getVoice<TVoice>();
+      mWrite.store(++w, std::memory_order_release);
+    }
+  }
+
+  // Audio thread: a voice to trigger, or nullptr if none is ready
+  TVoice* take() {
+    size_t r = mRead.load(std::memory_order_relaxed);
+    if (r == mWrite.load(std::memory_order_acquire)) {
+      mMissed.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    TVoice* voice = mVoices[r % CAPACITY];
+    mRead.store(r + 1, std::memory_order_release);
+    return voice;
+  }
+
+  // Notes dropped because no voice was ready
+  uint64_t missed() const { return mMissed.load(std::memory_order_relaxed); }
+
+private:
+  TVoice* mVoices[CAPACITY];
+  std::atomic<size_t> mWrite{0}, mRead{0};
+  std::atomic<uint64_t> mMissed{0};
+};
+
+#endif
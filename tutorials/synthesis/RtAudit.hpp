@@ -0,0 +1,399 @@
+#pragma once
+#ifndef RtAudit_H
+#define RtAudit_H
+
+/*
+Checking that audio callbacks are real-time safe.
+
+Code run by onSound() must not allocate, lock a mutex, or do I/O: any of
+them can block for longer than a buffer lasts. Nothing reports it when a
+voice does, e.g. resizes a vector in onTriggerOn() or prints in
+onProcess(); it just glitches now and then on stage.
+
+Define RTAUDIT before including this header and mark the callbacks:
+
+  #define RTAUDIT
+  #include "RtAudit.hpp"
+
+  void onSound(AudioIOData &io) override {
+    RTAUDIT_CALLBACK("onSound");
+    synth.render(io);
+  }
+
+  // in a voice
+  void onProcess(AudioIOData &io) override {
+    RTAUDIT_VOICE();
+    ...
+  }
+
+While a marked callback runs, every allocation, mutex lock and blocking
+call (read, write, open, sleeping, stdio output) on its thread is
+reported on stderr, once per distinct call stack, with the callback and
+voice class it happened in. RTAUDIT_VOICE() only names the voice; it does
+not start auditing on threads that are not in a callback. Use
+RtAudit::abortOnViolation(true) to stop at the first one.
+
+Without RTAUDIT the macros expand to nothing.
+
+RTAUDIT replaces malloc, free and the checked library calls for the whole
+program, so define it in one source file only. On Linux (glibc) all of
+them are checked; link with -rdynamic to get function names in the
+stacks. Elsewhere only operator new and delete are checked.
+*/
+
+#ifdef RTAUDIT
+
+#include <execinfo.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <typeinfo>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+#ifdef __GLIBC__
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <cstdarg>
+#endif
+
+#define RTAUDIT_CONCAT_(a, b) a##b
+#define RTAUDIT_CONCAT(a, b) RTAUDIT_CONCAT_(a, b)
+#define RTAUDIT_CALLBACK(name) \
+  RtAudit::Scope RTAUDIT_CONCAT(rtauditScope, __LINE__)(name, true)
+#define RTAUDIT_VOICE()                                                 \
+  RtAudit::Scope RTAUDIT_CONCAT(rtauditScope, __LINE__)(typeid(*this), \
+                                                        false)
+
+class RtAudit {
+public:
+  static const int MAX_DEPTH = 8;
+
+  // Marks the calling thread as inside a callback (audit = true) or a
+  // voice for as long as it exists
+  class Scope {
+  public:
+    Scope(const char* name, bool audit) : mAudit(audit) {
+      push(name, nullptr);
+    }
+    Scope(const std::type_info& type, bool audit) : mAudit(audit) {
+      push(nullptr, &type);
+    }
+    ~Scope() {
+      Context& c = context();
+      if (c.depth-- > MAX_DEPTH) return;
+      if (mAudit) c.audited--;
+    }
+
+  private:
+    void push(const char* name, const std::type_info* type) {
+      Context& c = context();
+      if (c.depth < MAX_DEPTH) {
+        c.names[c.depth] = name;
+        c.types[c.depth] = type;
+        if (mAudit) c.audited++;
+      }
+      c.depth++;
+    }
+
+    bool mAudit;
+  };
+
+  static void abortOnViolation(bool a) { state().abort = a; }
+
+  // Number of violations found, including repeated ones
+  static uint64_t violations() { return state().violations.load(); }
+
+  // Called by the hooks. Reports what if the calling thread is audited.
+  static void check(const char* what) {
+    Context& c = context();
+    if (c.audited == 0 || c.inHook) return;
+    c.inHook = true;
+    report(what, c);
+    c.inHook = false;
+  }
+
+  // Run f without reporting, e.g. to resolve the real functions
+  static bool suspended() { return context().inHook; }
+  static void suspend(bool s) { context().inHook = s; }
+
+private:
+  struct Context {
+    int depth;
+    int audited;
+    bool inHook;
+    const char* names[MAX_DEPTH];
+    const std::type_info* types[MAX_DEPTH];
+  };
+
+  struct State {
+    std::atomic<uint64_t> violations{0};
+    std::atomic<uint64_t> reported[4096];  // hashes of reported stacks
+    bool abort = false;
+  };
+
+  // Plain data, so using it from malloc never allocates or runs a
+  // constructor
+  static Context& context() {
+    static thread_local Context c;
+    return c;
+  }
+
+  static State& state() {
+    static State s;
+    return s;
+  }
+
+  static void report(const char* what, const Context& c) {
+    State& s = state();
+    s.violations++;
+    void* frames[32];
+    int n = backtrace(frames, 32);
+    // report each call stack once
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < n; i++) {
+      hash = (hash ^ uint64_t(uintptr_t(frames[i]))) * 1099511628211ull;
+    }
+    if (hash == 0) hash = 1;
+    bool isNew = false;
+    for (size_t i = 0; i < 4096; i++) {
+      auto& slot = s.reported[(hash + i) % 4096];
+      uint64_t expected = 0;
+      if (slot.compare_exchange_strong(expected, hash)) {
+        isNew = true;
+        break;
+      }
+      if (expected == hash) break;
+    }
+    if (!isNew && !s.abort) return;
+
+    char line[512];
+    int length = std::snprintf(line, sizeof(line),
+                               "RtAudit: %s on the audio thread in", what);
+    for (int i = 0; i < c.depth && i < MAX_DEPTH; i++) {
+      const char* name = c.names[i];
+      char* demangled = nullptr;
+#ifdef __GNUC__
+      if (c.types[i]) {
+        int status;
+        demangled = abi::__cxa_demangle(c.types[i]->name(), nullptr, nullptr,
+                                        &status);
+      }
+#endif
+      if (c.types[i]) name = demangled ? demangled : c.types[i]->name();
+      if (length < int(sizeof(line))) {
+        length += std::snprintf(line + length, sizeof(line) - length, "%s %s",
+                                i == 0 ? "" : " >", name);
+      }
+      std::free(demangled);
+    }
+    if (length >= int(sizeof(line))) length = sizeof(line) - 1;
+    line[length++] = '\n';
+    writeError(line, length);
+    backtrace_symbols_fd(frames + 2, n > 2 ? n - 2 : 0, STDERR_FILENO);
+    if (s.abort) std::abort();
+  }
+
+  static void writeError(const char* text, size_t size);
+};
+
+#ifdef __GLIBC__
+
+// glibc: replace the C functions. The originals are reached through
+// __libc_malloc and friends, and dlsym(RTLD_NEXT) for the rest.
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+}
+
+template <class F>
+static F rtauditReal(const char* name) {
+  bool suspended = RtAudit::suspended();
+  RtAudit::suspend(true);  // dlsym can allocate
+  F f = (F)dlsym(RTLD_NEXT, name);
+  RtAudit::suspend(suspended);
+  return f;
+}
+
+#define RTAUDIT_REAL(name) \
+  static auto real = rtauditReal<decltype(&::name)>(#name)
+
+inline void RtAudit::writeError(const char* text, size_t size) {
+  RTAUDIT_REAL(write);
+  real(STDERR_FILENO, text, size);
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+  RtAudit::check("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  RtAudit::check("calloc");
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+  RtAudit::check("realloc");
+  return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+  if (p) RtAudit::check("free");
+  __libc_free(p);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* m) {
+  RTAUDIT_REAL(pthread_mutex_lock);
+  RtAudit::check("pthread_mutex_lock");
+  return real(m);
+}
+
+ssize_t read(int fd, void* buffer, size_t size) {
+  RTAUDIT_REAL(read);
+  RtAudit::check("read");
+  return real(fd, buffer, size);
+}
+
+ssize_t write(int fd, const void* buffer, size_t size) {
+  RTAUDIT_REAL(write);
+  RtAudit::check("write");
+  return real(fd, buffer, size);
+}
+
+int open(const char* path, int flags, ...) {
+  RTAUDIT_REAL(open);
+  RtAudit::check("open");
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags & O_CREAT) ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  return real(path, flags, mode);
+}
+
+int nanosleep(const struct timespec* duration, struct timespec* remaining) {
+  RTAUDIT_REAL(nanosleep);
+  RtAudit::check("nanosleep");
+  return real(duration, remaining);
+}
+
+int usleep(useconds_t usec) {
+  RTAUDIT_REAL(usleep);
+  RtAudit::check("usleep");
+  return real(usec);
+}
+
+// stdio, which std::cout writes through
+
+FILE* fopen(const char* path, const char* mode) {
+  RTAUDIT_REAL(fopen);
+  RtAudit::check("fopen");
+  return real(path, mode);
+}
+
+size_t fwrite(const void* buffer, size_t size, size_t count, FILE* f) {
+  RTAUDIT_REAL(fwrite);
+  RtAudit::check("fwrite");
+  return real(buffer, size, count, f);
+}
+
+int fputs(const char* s, FILE* f) {
+  RTAUDIT_REAL(fputs);
+  RtAudit::check("fputs");
+  return real(s, f);
+}
+
+int puts(const char* s) {
+  RTAUDIT_REAL(puts);
+  RtAudit::check("puts");
+  return real(s);
+}
+
+int fputc(int c, FILE* f) {
+  RTAUDIT_REAL(fputc);
+  RtAudit::check("fputc");
+  return real(c, f);
+}
+
+int putc(int c, FILE* f) {
+  RTAUDIT_REAL(putc);
+  RtAudit::check("putc");
+  return real(c, f);
+}
+
+int fflush(FILE* f) {
+  RTAUDIT_REAL(fflush);
+  RtAudit::check("fflush");
+  return real(f);
+}
+
+int printf(const char* format, ...) {
+  RTAUDIT_REAL(vprintf);
+  RtAudit::check("printf");
+  va_list args;
+  va_start(args, format);
+  int n = real(format, args);
+  va_end(args);
+  return n;
+}
+
+int fprintf(FILE* f, const char* format, ...) {
+  RTAUDIT_REAL(vfprintf);
+  RtAudit::check("fprintf");
+  va_list args;
+  va_start(args, format);
+  int n = real(f, format, args);
+  va_end(args);
+  return n;
+}
+
+}  // extern "C"
+
+#else
+
+// Elsewhere: only C++ allocations
+
+inline void RtAudit::writeError(const char* text, size_t size) {
+  ::write(STDERR_FILENO, text, size);
+}
+
+void* operator new(size_t size) {
+  RtAudit::check("operator new");
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* p) noexcept {
+  if (p) RtAudit::check("operator delete");
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+
+#endif
+
+#else
+
+#define RTAUDIT_CALLBACK(name) ((void)0)
+#define RTAUDIT_VOICE() ((void)0)
+
+#endif
+
+#endif
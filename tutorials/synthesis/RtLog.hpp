@@ -0,0 +1,372 @@
+#pragma once
+#ifndef RtLog_H
+#define RtLog_H
+
+/*
+Logging from real-time callbacks.
+
+std::cout in onProcess() or a trigger callback formats the message and
+writes it to the console right there, once per voice per frame or per
+note. That usually takes longer than the work being logged.
+
+The RTLOG_ macros format nothing on the calling thread. They store the
+format string pointer and the arguments, as binary values, in a
+preallocated lock-free ring that belongs to the calling thread. A
+background thread collects the rings every few milliseconds, formats the
+messages in time order and writes them to stdout in one batch:
+
+  RTLOG_DEBUG("frequency at onProcess: {}", frequency);
+  RTLOG_WARN("voice {} has no envelope", id);
+
+Each {} in the format is replaced by the next argument. The format must be
+a string literal, and a const char* argument must stay valid until it is
+printed (a literal or a static string). Up to 8 numbers, bools or strings
+can be logged per message.
+
+Each call site prints at most rateLimit() messages per second. Further
+messages are counted and the count is shown with the next message that
+prints. When a thread's ring is full, its messages are dropped and
+counted (dropped()).
+
+Messages below RTLOG_LEVEL are removed at compile time, arguments
+included, so they cost nothing:
+
+  #define RTLOG_LEVEL RTLOG_LEVEL_WARN  // before including RtLog.hpp
+
+A thread gets its ring the first time it logs. The first few threads take
+rings allocated with the log, without locking; later ones allocate theirs.
+Create the log before audio starts, e.g. with RtLog::instance() in
+onCreate(), so its writer thread is not started from a callback, and call
+RtLog::instance().prepareThread() at the start of onSound() to take the
+audio thread's ring before it logs.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define RTLOG_LEVEL_DEBUG 0
+#define RTLOG_LEVEL_INFO 1
+#define RTLOG_LEVEL_WARN 2
+#define RTLOG_LEVEL_ERROR 3
+#define RTLOG_LEVEL_NONE 4
+
+#ifndef RTLOG_LEVEL
+#define RTLOG_LEVEL RTLOG_LEVEL_DEBUG
+#endif
+
+#define RTLOG_AT(level, ...)                                   \
+  do {                                                         \
+    static RtLog::Site rtlogSite;                              \
+    RtLog::instance().log(rtlogSite, level, __VA_ARGS__);      \
+  } while (0)
+
+#if RTLOG_LEVEL <= RTLOG_LEVEL_DEBUG
+#define RTLOG_DEBUG(...) RTLOG_AT(RTLOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define RTLOG_DEBUG(...) ((void)0)
+#endif
+
+#if RTLOG_LEVEL <= RTLOG_LEVEL_INFO
+#define RTLOG_INFO(...) RTLOG_AT(RTLOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define RTLOG_INFO(...) ((void)0)
+#endif
+
+#if RTLOG_LEVEL <= RTLOG_LEVEL_WARN
+#define RTLOG_WARN(...) RTLOG_AT(RTLOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define RTLOG_WARN(...) ((void)0)
+#endif
+
+#if RTLOG_LEVEL <= RTLOG_LEVEL_ERROR
+#define RTLOG_ERROR(...) RTLOG_AT(RTLOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define RTLOG_ERROR(...) ((void)0)
+#endif
+
+class RtLog {
+public:
+  static const int MAX_ARGS = 8;
+  static const int PREALLOCATED_RINGS = 8;
+
+  // State of one call site, for rate limiting
+  struct Site {
+    std::atomic<uint64_t> second{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+  };
+
+  static RtLog& instance() {
+    static RtLog log;
+    return log;
+  }
+
+  ~RtLog() {
+    mRunning = false;
+    mThread.join();
+    flush();
+  }
+
+  // Messages per call site per second
+  void rateLimit(uint32_t perSecond) { mRateLimit = perSecond; }
+  uint32_t rateLimit() const { return mRateLimit; }
+
+  uint64_t dropped() const { return mDropped.load(); }
+
+  // Take the calling thread's ring now instead of on its first message.
+  // Cheap once the thread has one.
+  void prepareThread() { threadRing(); }
+
+  template <class... Args>
+  void log(Site& site, int level, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "too many RTLOG arguments");
+    uint64_t now = nanoseconds();
+    uint32_t suppressed = 0;
+    if (!admit(site, now, suppressed)) return;
+    Ring* ring = threadRing();
+    Record* r = ring->claim();
+    if (!r) {
+      mDropped++;
+      return;
+    }
+    Arg values[] = {toArg(args)..., Arg()};
+    r->format = format;
+    r->time = now;
+    r->suppressed = suppressed;
+    r->level = uint8_t(level);
+    r->count = uint8_t(sizeof...(Args));
+    std::copy(values, values + sizeof...(Args), r->args);
+    ring->commit();
+  }
+
+private:
+  struct Arg {
+    enum Type : uint8_t { INT, UINT, DOUBLE, BOOL, STRING };
+    Type type = INT;
+    union {
+      int64_t i;
+      uint64_t u;
+      double d;
+      const char* s;
+    };
+    Arg() : i(0) {}
+  };
+
+  struct Record {
+    const char* format;
+    uint64_t time;
+    uint32_t suppressed;
+    uint8_t level;
+    uint8_t count;
+    Arg args[MAX_ARGS];
+  };
+
+  // Single producer (the owning thread), single consumer (the writer)
+  struct Ring {
+    static const uint32_t SIZE = 512;
+    Record records[SIZE];
+    std::atomic<uint32_t> head{0}, tail{0};
+
+    Record* claim() {
+      uint32_t h = head.load(std::memory_order_relaxed);
+      if (h - tail.load(std::memory_order_acquire) == SIZE) return nullptr;
+      return &records[h % SIZE];
+    }
+    void commit() { head.fetch_add(1, std::memory_order_release); }
+
+    bool pop(Record& r) {
+      uint32_t t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire)) return false;
+      r = records[t % SIZE];
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+  };
+
+  RtLog() : mPreallocated(new Ring[PREALLOCATED_RINGS]) {
+    mRunning = true;
+    mThread = std::thread([this] {
+      while (mRunning) {
+        flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    });
+  }
+
+  template <class T>
+  static typename std::enable_if<std::is_integral<T>::value &&
+                                     std::is_signed<T>::value,
+                                 Arg>::type
+  toArg(T v) {
+    Arg a;
+    a.type = Arg::INT;
+    a.i = v;
+    return a;
+  }
+
+  template <class T>
+  static typename std::enable_if<std::is_integral<T>::value &&
+                                     !std::is_signed<T>::value,
+                                 Arg>::type
+  toArg(T v) {
+    Arg a;
+    a.type = Arg::UINT;
+    a.u = v;
+    return a;
+  }
+
+  static Arg toArg(bool v) {
+    Arg a;
+    a.type = Arg::BOOL;
+    a.i = v;
+    return a;
+  }
+
+  static Arg toArg(double v) {
+    Arg a;
+    a.type = Arg::DOUBLE;
+    a.d = v;
+    return a;
+  }
+
+  static Arg toArg(float v) { return toArg(double(v)); }
+
+  static Arg toArg(const char* v) {
+    Arg a;
+    a.type = Arg::STRING;
+    a.s = v;
+    return a;
+  }
+
+  static uint64_t nanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool admit(Site& site, uint64_t now, uint32_t& suppressed) {
+    uint64_t second = now / 1000000000;
+    if (site.second.load(std::memory_order_relaxed) != second) {
+      site.second.store(second, std::memory_order_relaxed);
+      site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= mRateLimit) {
+      site.suppressed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  Ring* threadRing() {
+    static thread_local Ring* ring = nullptr;
+    if (!ring) {
+      int index = mClaimed.fetch_add(1, std::memory_order_acq_rel);
+      if (index < PREALLOCATED_RINGS) {
+        ring = &mPreallocated[index];
+      } else {
+        std::unique_ptr<Ring> allocated(new Ring);
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        mRings.push_back(std::move(allocated));
+        ring = mRings.back().get();
+      }
+    }
+    return ring;
+  }
+
+  // Writer thread: print everything queued, in time order
+  void flush() {
+    std::lock_guard<std::mutex> lock(mFlushMutex);
+    // Drain outside mRingsMutex, so threads taking a ring never wait for
+    // the writer
+    int claimed = mClaimed.load(std::memory_order_acquire);
+    mDraining.clear();
+    for (int i = 0; i < claimed && i < PREALLOCATED_RINGS; i++) {
+      mDraining.push_back(&mPreallocated[i]);
+    }
+    {
+      std::lock_guard<std::mutex> ringsLock(mRingsMutex);
+      for (auto& ring : mRings) mDraining.push_back(ring.get());
+    }
+    Record r;
+    for (Ring* ring : mDraining) {
+      while (ring->pop(r)) mPending.push_back(r);
+    }
+    if (mPending.empty()) return;
+    std::stable_sort(mPending.begin(), mPending.end(),
+                     [](const Record& a, const Record& b) { return a.time < b.time; });
+    mText.clear();
+    for (auto& r : mPending) format(r, mText);
+    mPending.clear();
+    std::fwrite(mText.data(), 1, mText.size(), stdout);
+    std::fflush(stdout);
+  }
+
+  static void format(const Record& r, std::string& out) {
+    static const char* prefixes[] = {"", "", "warning: ", "error: "};
+    if (r.level < 4) out += prefixes[r.level];
+    int next = 0;
+    for (const char* c = r.format; *c; c++) {
+      if (c[0] == '{' && c[1] == '}' && next < r.count) {
+        appendArg(r.args[next++], out);
+        c++;
+      } else {
+        out += *c;
+      }
+    }
+    if (r.suppressed > 0) {
+      out += " (" + std::to_string(r.suppressed) + " more suppressed)";
+    }
+    out += '\n';
+  }
+
+  static void appendArg(const Arg& a, std::string& out) {
+    char text[32];
+    switch (a.type) {
+      case Arg::INT:
+        std::snprintf(text, sizeof(text), "%" PRId64, a.i);
+        break;
+      case Arg::UINT:
+        std::snprintf(text, sizeof(text), "%" PRIu64, a.u);
+        break;
+      case Arg::DOUBLE:
+        std::snprintf(text, sizeof(text), "%g", a.d);
+        break;
+      case Arg::BOOL:
+        out += a.i ? "true" : "false";
+        return;
+      case Arg::STRING:
+        out += a.s ? a.s : "(null)";
+        return;
+    }
+    out += text;
+  }
+
+  std::atomic<uint32_t> mRateLimit{20};
+  std::atomic<uint64_t> mDropped{0};
+
+  std::unique_ptr<Ring[]> mPreallocated;
+  std::atomic<int> mClaimed{0};
+  std::mutex mRingsMutex;  // rings allocated after the preallocated ones
+  std::vector<std::unique_ptr<Ring>> mRings;
+
+  std::mutex mFlushMutex;
+  std::vector<Ring*> mDraining;
+  std::vector<Record> mPending;
+  std::string mText;
+
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+};
+
+#endif
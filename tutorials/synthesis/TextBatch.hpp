@@ -0,0 +1,168 @@
+#pragma once
+#ifndef TextBatch_H
+#define TextBatch_H
+
+/*
+Cached, batched text labels.
+
+Writing a string with Font::write() or FontRenderer::write() lays out its
+glyphs into a new mesh, and drawing it is one draw call per label. A HUD or
+a keyboard with dozens of labels redoes the layout of every label every
+frame and issues dozens of draw calls.
+
+TextBatch lays out each distinct (text, size) once and keeps the result in
+a cache. Labels added to the batch are copied from the cache, moved to their
+position, and merged into a single vertex buffer that is uploaded only when
+the labels change. Drawing the batch is one draw call, as all its glyphs
+share the font's atlas texture.
+
+Rebuild the batch (clear() and add()) only when labels change or move, not
+every frame. For numbers that change every frame, use addNumber(), which
+reuses the layouts of single digits. Every label of a batch is drawn with
+the same color; set it with g.tint() before draw(), and use one batch per
+color.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "al/graphics/al_Font.hpp"
+#include "al/graphics/al_Graphics.hpp"
+#include "al/graphics/al_VAOMesh.hpp"
+
+class TextBatch {
+public:
+  explicit TextBatch(al::Font& font, size_t maxCachedStrings = 1024)
+      : mFont(font), mMaxCached(maxCachedStrings) {
+    mMesh.primitive(al::Mesh::TRIANGLES);
+  }
+
+  // Remove all labels. Cached layouts are kept.
+  void clear() {
+    mMesh.reset();
+    mMesh.primitive(al::Mesh::TRIANGLES);
+    mLabels = 0;
+    mDirty = true;
+  }
+
+  // Add a label at (x, y, z). size is the height of the text, as in
+  // Font::write().
+  void add(const std::string& text, float size, float x, float y,
+           float z = 0) {
+    const al::Mesh& glyphs = layout(text, size);
+    unsigned int base = (unsigned int)mMesh.vertices().size();
+    for (auto& v : glyphs.vertices()) {
+      mMesh.vertex(v.x + x, v.y + y, v.z + z);
+    }
+    for (auto& t : glyphs.texCoord2s()) {
+      mMesh.texCoord(t.x, t.y);
+    }
+    if (glyphs.indices().empty()) {
+      // keep the batch indexed so labels can be merged freely
+      for (unsigned int i = 0; i < glyphs.vertices().size(); i++) {
+        mMesh.index(base + i);
+      }
+    } else {
+      for (auto i : glyphs.indices()) mMesh.index(base + i);
+    }
+    mLabels++;
+    mDirty = true;
+  }
+
+  // Add a number at (x, y, z), aligned like the font aligns text. The
+  // number is put together from the cached layouts of its digits, so values
+  // that change every frame (counters, readouts) do not lay out new text.
+  // Digits are placed a fixed advance apart, as digits of most fonts have
+  // the same width.
+  void addNumber(long value, float size, float x, float y, float z = 0) {
+    char digits[32];
+    int n = std::snprintf(digits, sizeof(digits), "%ld", value);
+    DigitMetrics m = digitMetrics(size);  // copy, add() may clear the cache
+    float offset = -(n - 1) * m.shift;
+    for (int i = 0; i < n; i++) {
+      add(std::string(1, digits[i]), size, x + offset + i * m.advance, y, z);
+    }
+  }
+
+  // Draw all labels with one draw call
+  void draw(al::Graphics& g) {
+    if (mDirty) {
+      mMesh.update();
+      mDirty = false;
+    }
+    if (mMesh.indices().empty()) return;
+    g.texture();
+    mFont.tex.bind();
+    g.draw(mMesh);
+    mFont.tex.unbind();
+  }
+
+  // Forget cached layouts, e.g. after loading a different font
+  void clearCache() {
+    mCache.clear();
+    mDigitMetrics.clear();
+  }
+
+  size_t labels() const { return mLabels; }
+  size_t cachedStrings() const { return mCache.size(); }
+
+private:
+  struct DigitMetrics {
+    float advance;  // distance between digits
+    float shift;    // how far the font moves text left per added character
+  };
+
+  // Measured by laying out "0" and "00"
+  const DigitMetrics& digitMetrics(float size) {
+    auto it = mDigitMetrics.find(size);
+    if (it == mDigitMetrics.end()) {
+      float min1, max1, min2, max2;
+      extent(layout("0", size), min1, max1);
+      extent(layout("00", size), min2, max2);
+      DigitMetrics m;
+      m.advance = (max2 - min2) - (max1 - min1);
+      m.shift = min1 - min2;
+      it = mDigitMetrics.emplace(size, m).first;
+    }
+    return it->second;
+  }
+
+  static void extent(const al::Mesh& mesh, float& min, float& max) {
+    min = max = 0;
+    if (mesh.vertices().empty()) return;
+    min = max = mesh.vertices()[0].x;
+    for (auto& v : mesh.vertices()) {
+      min = std::min(min, v.x);
+      max = std::max(max, v.x);
+    }
+  }
+
+  const al::Mesh& layout(const std::string& text, float size) {
+    auto key = std::make_pair(text, size);
+    auto it = mCache.find(key);
+    if (it == mCache.end()) {
+      // strings that change all the time (counters, values) would fill the
+      // cache forever; start over when it is full
+      if (mCache.size() >= mMaxCached) {
+        mCache.clear();
+        mDigitMetrics.clear();
+      }
+      it = mCache.emplace(key, al::Mesh()).first;
+      mFont.write(it->second, text.c_str(), size);
+    }
+    return it->second;
+  }
+
+  al::Font& mFont;
+  size_t mMaxCached;
+  std::map<std::pair<std::string, float>, al::Mesh> mCache;
+  std::map<float, DigitMetrics> mDigitMetrics;
+  al::VAOMesh mMesh;
+  bool mDirty = true;
+  size_t mLabels = 0;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#pragma once
+#ifndef TimingWheel_H
+#define TimingWheel_H
+
+/*
+Scheduling large numbers of events for the audio thread.
+
+A sorted list of pending events costs O(n) per insertion and has to be
+locked while the GUI adds events and the audio thread takes them out, so
+generative pieces that schedule many thousands of notes slow down every
+audio block.
+
+TimingWheel is a hierarchical timing wheel: four levels of 256 slots, each
+level 256 times coarser than the one below. An event goes into the slot of
+the level that covers its distance from now, which is O(1), and is moved
+one level down when its slot comes close; each event is moved at most
+three times. An audio block only visits the few level 0 slots it covers,
+so its cost depends on the events due in that block, not on how many are
+pending.
+
+Any thread may schedule events: they are handed to the audio thread
+through a lock-free list and only the audio thread touches the wheel.
+Event memory is allocated on the scheduling side and recycled
+(RecyclingPool), so the audio thread never allocates or frees.
+
+VoiceScheduler uses a TimingWheel to start and stop PolySynth voices at
+sample accurate times, like SynthSequencer::addVoiceFromNow(). Trigger
+parameters (TriggerParams.hpp) travel with the note on, in a recycled
+block the event points to, so firing a note never allocates.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+#include "TriggerParams.hpp"
+
+// Objects allocated by producer threads and recycled by the audio thread.
+// allocate() takes a lock and allocates in blocks when nothing was
+// recycled; recycle() is lock-free and never frees. T must have a
+// `T* next` member, which the pool uses while the object is free.
+template <class T>
+class RecyclingPool {
+public:
+  T* allocate() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mFree) {
+      mFree = mRecycled.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!mFree) {
+      const size_t count = 1024;
+      mBlocks.emplace_back(new T[count]);
+      T* block = mBlocks.back().get();
+      for (size_t i = 0; i < count; i++) {
+        block[i].next = i + 1 < count ? &block[i + 1] : nullptr;
+      }
+      mFree = block;
+    }
+    T* t = mFree;
+    mFree = t->next;
+    return t;
+  }
+
+  void recycle(T* t) {
+    T* head = mRecycled.load(std::memory_order_relaxed);
+    do {
+      t->next = head;
+    } while (!mRecycled.compare_exchange_weak(head, t, std::memory_order_release,
+                                              std::memory_order_relaxed));
+  }
+
+private:
+  std::mutex mMutex;  // allocating side only
+  T* mFree = nullptr;
+  std::atomic<T*> mRecycled{nullptr};
+  std::vector<std::unique_ptr<T[]>> mBlocks;
+};
+
+template <class Payload>
+class TimingWheel {
+public:
+  // tickShift: log2 of the samples per level 0 slot
+  // maxDue: events dispatched per advance(); more are left for the next one
+  explicit TimingWheel(int tickShift = 6, size_t maxDue = 4096)
+      : mShift(tickShift), mDue(std::max<size_t>(1, maxDue)) {
+    for (auto& level : mSlots) {
+      for (auto& slot : level) slot = nullptr;
+    }
+  }
+
+  // Any thread: schedule payload at sample time `time`
+  void schedule(uint64_t time, const Payload& payload) {
+    Event* e = mEvents.allocate();
+    e->time = time;
+    e->sequence = mSequence.fetch_add(1, std::memory_order_relaxed);
+    e->payload = payload;
+    Event* head = mIncoming.load(std::memory_order_relaxed);
+    do {
+      e->next = head;
+    } while (!mIncoming.compare_exchange_weak(head, e, std::memory_order_release,
+                                              std::memory_order_relaxed));
+    mPending.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Sample time up to which events have been dispatched
+  uint64_t now() const { return mNow.load(std::memory_order_acquire); }
+
+  // Events scheduled and not dispatched yet
+  size_t pending() const { return mPending.load(std::memory_order_relaxed); }
+
+  // Audio thread: call f(payload, time) for every event with time < end, in
+  // time order, and in scheduling order for equal times. Events scheduled in
+  // the past are dispatched immediately. If more than maxDue events are due,
+  // the rest are dispatched by the next call, as late events.
+  template <class F>
+  void advance(uint64_t end, F&& f) {
+    // take the events scheduled since the last call
+    Event* e = mIncoming.exchange(nullptr, std::memory_order_acquire);
+    while (e) {
+      Event* next = e->next;
+      insert(e);
+      e = next;
+    }
+
+    Event* late = take(mLate);
+    while (late) {
+      Event* next = late->next;
+      due(late);
+      late = next;
+    }
+    while (((mTick + 1) << mShift) <= end) {
+      cascade();
+      Event* slot = take(mSlots[0][mTick & MASK]);
+      while (slot) {
+        Event* next = slot->next;
+        due(slot);
+        slot = next;
+      }
+      mTick++;
+    }
+    // part of the current tick
+    if ((mTick << mShift) < end) {
+      cascade();
+      Event** link = &mSlots[0][mTick & MASK];
+      while (*link) {
+        Event* ev = *link;
+        if (ev->time < end) {
+          *link = ev->next;
+          due(ev);
+        } else {
+          link = &ev->next;
+        }
+      }
+    }
+
+    // in place, so nothing is allocated on the audio thread
+    std::sort(mDue.begin(), mDue.begin() + mDueCount,
+              [](const Event* a, const Event* b) {
+                return a->time < b->time ||
+                       (a->time == b->time && a->sequence < b->sequence);
+              });
+    for (size_t i = 0; i < mDueCount; i++) {
+      f(mDue[i]->payload, mDue[i]->time);
+      mEvents.recycle(mDue[i]);
+    }
+    mPending.fetch_sub(mDueCount, std::memory_order_relaxed);
+    mDueCount = 0;
+    mNow.store(std::max(end, mNow.load(std::memory_order_relaxed)),
+               std::memory_order_release);
+  }
+
+private:
+  static const int LEVELS = 4;
+  static const int BITS = 8;
+  static const uint64_t SLOTS = 1 << BITS;
+  static const uint64_t MASK = SLOTS - 1;
+
+  struct Event {
+    uint64_t time;
+    uint64_t sequence;  // orders events with the same time
+    Payload payload;
+    Event* next;
+  };
+
+  // wheel, audio thread only
+
+  void insert(Event* e) {
+    uint64_t tick = e->time >> mShift;
+    if (tick < mTick) {
+      push(mLate, e);
+      return;
+    }
+    uint64_t delta = tick - mTick;
+    for (int level = 0; level < LEVELS; level++) {
+      if (delta < (uint64_t(1) << (BITS * (level + 1)))) {
+        push(mSlots[level][(tick >> (BITS * level)) & MASK], e);
+        return;
+      }
+    }
+    push(mOverflow, e);
+  }
+
+  // When the current tick starts a new period of a level, move the events
+  // of that period down
+  void cascade() {
+    if (mCascaded == mTick + 1) return;  // done for this tick
+    mCascaded = mTick + 1;
+    if ((mTick & MASK) != 0) return;
+    int level = 1;
+    for (; level < LEVELS; level++) {
+      uint64_t index = (mTick >> (BITS * level)) & MASK;
+      reinsert(take(mSlots[level][index]));
+      if (index != 0) break;
+    }
+    if (level == LEVELS) reinsert(take(mOverflow));
+  }
+
+  void reinsert(Event* e) {
+    while (e) {
+      Event* next = e->next;
+      insert(e);
+      e = next;
+    }
+  }
+
+  void due(Event* e) {
+    if (mDueCount < mDue.size()) {
+      mDue[mDueCount++] = e;
+    } else {
+      push(mLate, e);  // full, next block
+    }
+  }
+
+  static void push(Event*& list, Event* e) {
+    e->next = list;
+    list = e;
+  }
+
+  static Event* take(Event*& list) {
+    Event* e = list;
+    list = nullptr;
+    return e;
+  }
+
+  const int mShift;
+
+  Event* mSlots[LEVELS][SLOTS];
+  Event* mOverflow = nullptr;
+  Event* mLate = nullptr;
+  uint64_t mTick = 0;      // first tick not completely dispatched
+  uint64_t mCascaded = 0;  // mTick + 1 once cascade() ran for mTick
+  std::vector<Event*> mDue;  // sized once, holds mDueCount events
+  size_t mDueCount = 0;
+
+  std::atomic<Event*> mIncoming{nullptr};
+  std::atomic<uint64_t> mSequence{0};
+  std::atomic<uint64_t> mNow{0};
+  std::atomic<size_t> mPending{0};
+
+  RecyclingPool<Event> mEvents;  // owns all events
+};
+
+// Starts and stops voices of a PolySynth at scheduled times
+class VoiceScheduler {
+public:
+  typedef TriggerParams<32> Params;
+
+  explicit VoiceScheduler(double sampleRate = 44100) : mSampleRate(sampleRate) {}
+
+  void sampleRate(double sr) { mSampleRate = sr; }
+
+  // Any thread: start voice `startTime` seconds from now and stop it
+  // `duration` seconds later. The voice must come from the synth passed to
+  // render(), e.g. from synth.getVoice<MyVoice>().
+  void addVoiceFromNow(al::SynthVoice* voice, double startTime,
+                       double duration) {
+    schedule(voice, startTime, duration, nullptr);
+  }
+
+  // As above, and set the voice's trigger parameters when it starts
+  void addVoiceFromNow(al::SynthVoice* voice, double startTime,
+                       double duration, const Params& params) {
+    StoredParams* stored = nullptr;
+    if (!params.empty()) {
+      stored = mParams.allocate();
+      stored->params = params;
+    }
+    schedule(voice, startTime, duration, stored);
+  }
+
+  // Audio thread: trigger the events due in this block, then render synth as
+  // usual
+  void render(al::PolySynth& synth, al::AudioIOData& io) {
+    uint64_t begin = mWheel.now();
+    mWheel.advance(begin + io.framesPerBuffer(),
+                   [&](Event& e, uint64_t time) {
+                     int offset = time > begin ? int(time - begin) : 0;
+                     if (e.on) {
+                       if (e.params) {
+                         e.params->params.apply(e.voice);
+                         mParams.recycle(e.params);
+                       }
+                       synth.triggerOn(e.voice, offset, e.id);
+                     } else {
+                       synth.triggerOff(e.id);
+                     }
+                   });
+  }
+
+  size_t pending() const { return mWheel.pending(); }
+
+private:
+  // Trigger parameters are kept out of the events, so note offs and notes
+  // without parameters stay small
+  struct StoredParams {
+    Params params;
+    StoredParams* next;
+  };
+
+  struct Event {
+    al::SynthVoice* voice;
+    int id;
+    bool on;
+    StoredParams* params;  // or nullptr
+  };
+
+  void schedule(al::SynthVoice* voice, double startTime, double duration,
+                StoredParams* params) {
+    uint64_t start = mWheel.now() + uint64_t(std::max(0.0, startTime) * mSampleRate);
+    uint64_t end = start + std::max<uint64_t>(1, uint64_t(duration * mSampleRate));
+    int id = mNextId.fetch_add(1);
+    mWheel.schedule(start, Event{voice, id, true, params});
+    mWheel.schedule(end, Event{nullptr, id, false, nullptr});
+  }
+
+  TimingWheel<Event> mWheel;
+  RecyclingPool<StoredParams> mParams;
+  double mSampleRate;
+  // voice ids, away from MIDI note numbers used as ids elsewhere
+  std::atomic<int> mNextId{1 << 20};
+};
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef TriggerEventLog_H
+#define TriggerEventLog_H
+
+/*
+Printing the trigger events of a synth.
+
+SynthRecorder::verbose(true) prints each event on the thread that
+triggered it, which is the audio thread for sequenced and scheduled notes.
+printTriggerEvents() prints them through an AsyncSynthRecorder instead, so
+the triggering thread only copies the event:
+
+  printTriggerEvents(synthManager.synth());  // e.g. in onCreate()
+
+All synths share one recorder and its writer thread, which last until the
+program exits.
+*/
+
+#include "../interaction-sequencing/AsyncSynthRecorder.hpp"
+
+inline AsyncSynthRecorder& triggerEventLog() {
+  static AsyncSynthRecorder log;
+  return log;
+}
+
+inline void printTriggerEvents(al::PolySynth& synth) {
+  AsyncSynthRecorder& log = triggerEventLog();
+  log.attach(synth);
+  if (!log.recording()) {
+    log.verbose(true);
+    log.start();
+  }
+}
+
+#endif
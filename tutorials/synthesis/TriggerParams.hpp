@@ -0,0 +1,62 @@
+#pragma once
+#ifndef TriggerParams_H
+#define TriggerParams_H
+
+/*
+Trigger parameters without heap allocation.
+
+voice->setTriggerParams({0.03, 440, ...}) builds a std::vector<float> for
+every note. A generative piece that schedules notes for hours allocates and
+frees one vector per note, and a sequencer that keeps the vectors until the
+notes play fragments the heap further.
+
+TriggerParams keeps up to Capacity values in an inline array, so it can be
+built on the stack or stored inside a scheduled event (see VoiceScheduler
+in TimingWheel.hpp, whose events are recycled when they retire) and applied
+to a voice without allocating:
+
+  TriggerParams<> params{0.2, 440, 0.1, 0.1, 0.0};
+  params.set(1, frequency);
+  params.apply(voice);
+*/
+
+#include <algorithm>
+#include <initializer_list>
+
+#include "al/scene/al_PolySynth.hpp"
+
+template <int Capacity = 32>
+class TriggerParams {
+public:
+  TriggerParams() = default;
+
+  // Values past Capacity are ignored
+  TriggerParams(std::initializer_list<float> values) {
+    for (float v : values) {
+      if (mCount == Capacity) break;
+      mValues[mCount++] = v;
+    }
+  }
+
+  // Set value i, extending the list with zeros if needed
+  void set(int i, float value) {
+    if (i < 0 || i >= Capacity) return;
+    while (mCount <= i) mValues[mCount++] = 0;
+    mValues[i] = value;
+  }
+
+  float operator[](int i) const { return mValues[i]; }
+  int size() const { return mCount; }
+  bool empty() const { return mCount == 0; }
+
+  // Set the voice's trigger parameters, in the order they were created
+  void apply(al::SynthVoice* voice) {
+    if (mCount > 0) voice->setTriggerParams(mValues, mCount);
+  }
+
+private:
+  float mValues[Capacity] = {};
+  int mCount = 0;
+};
+
+#endif
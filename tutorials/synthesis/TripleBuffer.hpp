@@ -0,0 +1,81 @@
+#pragma once
+#ifndef TripleBuffer_H
+#define TripleBuffer_H
+
+/*
+Handing the latest value of a small record from one thread to another.
+
+A triple buffer: one thread publishes records, the other reads the most
+recent complete one. Neither side waits for or locks the other, nothing is
+allocated, and a record is never seen half written. Records published
+faster than they are read are skipped, so it suits state ("the current
+level", "the current targets") rather than events.
+
+  TripleBuffer<State> mState;
+  mState.publish(state);       // writing thread
+  State s = mState.latest();   // reading thread
+
+VoiceTelemetry (VoiceTelemetry.hpp) uses it to pass audio features from
+voices to the graphics, PresetMorph to send ramps to the audio thread.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+template <class Record>
+class TripleBuffer {
+  static_assert(std::is_trivially_copyable<Record>::value,
+                "Records are copied on the real-time side and must be plain "
+                "data");
+
+public:
+  TripleBuffer() = default;
+  explicit TripleBuffer(const Record& initial) { reset(initial); }
+
+  // Set every buffer to a value. Not thread safe: call while neither side
+  // is using the buffer.
+  void reset(const Record& r) {
+    for (auto& s : mSlots) s.record = r;
+  }
+
+  // Writing thread: make r the latest record
+  void publish(const Record& r) {
+    mSlots[mBack].record = r;
+    mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Reading thread: take the latest record if one was published since the
+  // last call. Returns true if it is new.
+  bool update() {
+    if (!(mMiddle.load(std::memory_order_relaxed) & FRESH)) return false;
+    mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+
+  // Reading thread: the latest record
+  const Record& latest() {
+    update();
+    return mSlots[mFront].record;
+  }
+
+private:
+  static const uint8_t INDEX = 3;
+  static const uint8_t FRESH = 4;
+
+  // A cache line of padding after each record keeps the records the two
+  // threads use on separate cache lines. Owners such as synth voices are
+  // allocated with plain new, which does not honor alignas(64) in C++14, so
+  // padding is used instead of alignment.
+  struct Slot {
+    Record record{};
+    char padding[64];
+  };
+
+  Slot mSlots[3];
+  uint8_t mBack = 0;                 // written by the writing thread
+  uint8_t mFront = 1;                // read by the reading thread
+  std::atomic<uint8_t> mMiddle{2};   // handed over between them
+};
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef VoiceTelemetry_H
+#define VoiceTelemetry_H
+
+/*
+Passing audio features from a voice's audio callback to its graphics
+callback.
+
+Audio reactive voices compute values in onProcess(AudioIOData &), e.g. the
+output of an envelope follower, and use them in onProcess(Graphics &). The
+two run on different threads, so reading the audio thread's members
+directly from the graphics thread is a data race: the graphics may see a
+half written value or, with several values, values from different blocks.
+
+VoiceTelemetry is a triple buffer (TripleBuffer.hpp): the audio thread
+publishes a small record at the end of each block and the graphics thread
+reads the most recent complete one. Neither side waits for or locks the
+other, and nothing is allocated.
+
+  struct Features { float level; float vib; };
+  VoiceTelemetry<Features> mTelemetry;
+
+  // audio thread, once per block
+  mTelemetry.publish({mEnvFollow.value(), vibValue});
+  // graphics thread
+  Features f = mTelemetry.latest();
+*/
+
+#include "TripleBuffer.hpp"
+
+template <class Record>
+using VoiceTelemetry = TripleBuffer<Record>;
+
+#endif
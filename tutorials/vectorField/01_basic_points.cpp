@@ -5,7 +5,9 @@ Description:
 Tutorial to render vector fields.
 Various methods to handle computation and sophisticated rendering techniques.
 
-Basic example of vector field and rending with point meshes
+Basic example of vector field and rending with point meshes.
+The mesh is filled in bulk through MeshBuilder, which sizes the vertex and
+color arrays once and lets the field be computed in parallel.
 
 Author:
 Kon Hyong Kim - Jan 2021
@@ -13,6 +15,8 @@ Kon Hyong Kim - Jan 2021
 
 #include "al/app/al_App.hpp"
 #include <vector>
+
+#include "MeshBuilder.hpp"
 using namespace al;
 
 class FieldApp : public App {
@@ -46,35 +50,45 @@ public:
   }
 
   void onAnimate(double dt) {
-    // reset the mesh
-    mesh.reset();
     // configure the mesh to render using individual points
     mesh.primitive(Mesh::POINTS);
 
-    for (int j = 0; j < yRes; ++j) {
-      for (int i = 0; i < xRes; ++i) {
-        // get the middle of the pixel in a vector field -0.5~0.5 x -0.5~0.5
-        Vec3f p((i + 0.5f) / (float)xRes - 0.5f,
-                (j + 0.5f) / (float)yRes - 0.5f, 0.f);
-
-        // scale the vector field size
-        p *= scale;
-
-        // ** place to apply algorithms based on the vector field
-        // here we're coloring the vector field based on the radius
-        // and a sine wave as an example
-        float radius = p.mag();
-        // RGB that fluctuates from 0-1 based on radius and theta
-        // with different periods
-        Color color = Color(0.5f * sin(8.f * radius + theta) + 0.5f,
-                            0.5f * sin(7.f * radius + theta) + 0.5f,
-                            0.5f * sin(5.f * radius + theta) + 0.5f);
-
-        // here we're rendering a point based on the vector field
-        mesh.vertex(p);
-        mesh.color(color);
+    // size the vertex and color arrays for the whole field at once.
+    // storage is kept between frames, so this does not allocate after the
+    // first frame
+    MeshBuilder builder(mesh);
+    builder.begin(xRes * yRes, MeshBuilder::COLORS);
+    MeshSpan<Vec3f> positions = builder.positions();
+    MeshSpan<Color> colors = builder.colors();
+
+    // every point only depends on its own index, so rows of the field can be
+    // computed on separate threads, each writing straight into the mesh
+    parallelFor(yRes, [&](size_t rowBegin, size_t rowEnd) {
+      for (size_t j = rowBegin; j < rowEnd; ++j) {
+        for (int i = 0; i < xRes; ++i) {
+          // get the middle of the pixel in a vector field -0.5~0.5 x -0.5~0.5
+          Vec3f p((i + 0.5f) / (float)xRes - 0.5f,
+                  (j + 0.5f) / (float)yRes - 0.5f, 0.f);
+
+          // scale the vector field size
+          p *= scale;
+
+          // ** place to apply algorithms based on the vector field
+          // here we're coloring the vector field based on the radius
+          // and a sine wave as an example
+          float radius = p.mag();
+
+          // here we're rendering a point based on the vector field
+          // RGB that fluctuates from 0-1 based on radius and theta
+          // with different periods
+          size_t index = j * xRes + i;
+          positions[index] = p;
+          colors[index] = Color(0.5f * sin(8.f * radius + theta) + 0.5f,
+                                0.5f * sin(7.f * radius + theta) + 0.5f,
+                                0.5f * sin(5.f * radius + theta) + 0.5f);
+        }
       }
-    }
+    }, 16);
 
     // increment the phase based on the time elapsed from last frame
     // this allows animation to look smooth regardless of fps
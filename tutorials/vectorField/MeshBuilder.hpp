@@ -0,0 +1,213 @@
+#pragma once
+#ifndef MeshBuilder_H
+#define MeshBuilder_H
+
+/*
+Bulk mesh filling helper for the vector field tutorials.
+
+Mesh::vertex() / Mesh::color() push_back one element at a time, which is
+fine for a handful of vertices but becomes the bottleneck when a point
+cloud with hundreds of thousands of vertices is rebuilt every frame.
+
+MeshBuilder sizes the attribute arrays of a mesh once and hands out plain
+writable spans over them, so producers can fill positions, colors and
+texture coordinates with tight (and optionally multithreaded) loops, run
+by a pool of worker threads that persists between frames:
+
+  MeshBuilder builder(mesh);
+  builder.begin(count, MeshBuilder::COLORS);
+  MeshSpan<Vec3f> pos = builder.positions();
+  MeshSpan<Color> col = builder.colors();
+  parallelFor(count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) { pos[i] = ...; col[i] = ...; }
+  });
+
+The mesh keeps its storage between frames: as long as the vertex count
+does not grow, begin() performs no allocation.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "al/graphics/al_Mesh.hpp"
+
+// Non owning view over a contiguous range of mesh attributes
+template <class T>
+struct MeshSpan {
+  T* data = nullptr;
+  size_t size = 0;
+
+  T& operator[](size_t i) { return data[i]; }
+  const T& operator[](size_t i) const { return data[i]; }
+  T* begin() { return data; }
+  T* end() { return data + size; }
+  bool empty() const { return size == 0; }
+};
+
+class MeshBuilder {
+public:
+  // attributes to size alongside positions
+  enum Attributes : unsigned {
+    POSITIONS_ONLY = 0,
+    COLORS = 1 << 0,
+    TEXCOORDS = 1 << 1,
+    NORMALS = 1 << 2
+  };
+
+  explicit MeshBuilder(al::Mesh& mesh) : mMesh(mesh) {}
+
+  // Resize the selected attribute arrays to count elements. Attributes that
+  // are not selected are cleared so the mesh stays consistent.
+  void begin(size_t count, unsigned attributes = POSITIONS_ONLY) {
+    mCount = count;
+    mMesh.indices().clear();
+    mMesh.vertices().resize(count);
+    fit(mMesh.colors(), attributes & COLORS);
+    fit(mMesh.texCoord2s(), attributes & TEXCOORDS);
+    fit(mMesh.normals(), attributes & NORMALS);
+  }
+
+  size_t count() const { return mCount; }
+
+  MeshSpan<al::Vec3f> positions() { return span(mMesh.vertices()); }
+  MeshSpan<al::Color> colors() { return span(mMesh.colors()); }
+  MeshSpan<al::Vec2f> texCoords() { return span(mMesh.texCoord2s()); }
+  MeshSpan<al::Vec3f> normals() { return span(mMesh.normals()); }
+
+  al::Mesh& mesh() { return mMesh; }
+
+private:
+  template <class T>
+  void fit(std::vector<T>& v, bool enabled) {
+    if (enabled) {
+      v.resize(mCount);
+    } else {
+      v.clear();
+    }
+  }
+
+  template <class T>
+  MeshSpan<T> span(std::vector<T>& v) {
+    MeshSpan<T> s;
+    s.data = v.data();
+    s.size = v.size();
+    return s;
+  }
+
+  al::Mesh& mMesh;
+  size_t mCount = 0;
+};
+
+// Persistent worker threads that run parallelFor() jobs. Starting threads
+// costs more than filling a field of a few hundred thousand points, so the
+// workers are created once and wait for work between frames.
+class WorkerPool {
+public:
+  explicit WorkerPool(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // the calling thread works too
+    for (unsigned i = 1; i < threads; i++) {
+      mWorkers.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mRunning = false;
+    }
+    mStart.notify_all();
+    for (auto& w : mWorkers) w.join();
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  unsigned threads() const { return unsigned(mWorkers.size()) + 1; }
+
+  // Split [0, count) into contiguous chunks of at least minChunk elements
+  // and run func(begin, end) on them from all threads. Returns when every
+  // chunk is done. Small ranges are run inline.
+  template <class Func>
+  void parallelFor(size_t count, Func func, size_t minChunk = 4096) {
+    size_t chunks = std::min<size_t>(threads(), count / std::max<size_t>(1, minChunk));
+    if (chunks <= 1) {
+      func(size_t(0), count);
+      return;
+    }
+    mFunc = [&func](size_t begin, size_t end) { func(begin, end); };
+    mCount = count;
+    mChunk = (count + chunks - 1) / chunks;
+    mNext = 0;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mActive = unsigned(mWorkers.size());
+      mJob++;
+    }
+    mStart.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFinished.wait(lock, [this] { return mActive == 0; });
+  }
+
+private:
+  void work() {
+    while (true) {
+      size_t begin = mNext.fetch_add(mChunk);
+      if (begin >= mCount) break;
+      mFunc(begin, std::min(mCount, begin + mChunk));
+    }
+  }
+
+  void workerLoop() {
+    unsigned job = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStart.wait(lock, [&] { return !mRunning || mJob != job; });
+        if (!mRunning) return;
+        job = mJob;
+      }
+      work();
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mActive--;
+      }
+      mFinished.notify_one();
+    }
+  }
+
+  // current job, shared with the workers
+  std::function<void(size_t, size_t)> mFunc;
+  size_t mCount = 0;
+  size_t mChunk = 1;
+  std::atomic<size_t> mNext{0};
+
+  std::mutex mMutex;
+  std::condition_variable mStart, mFinished;
+  unsigned mJob = 0;
+  unsigned mActive = 0;
+  bool mRunning = true;
+  std::vector<std::thread> mWorkers;
+};
+
+// Pool shared by the whole application, created on first use
+inline WorkerPool& sharedWorkerPool() {
+  static WorkerPool pool;
+  return pool;
+}
+
+template <class Func>
+void parallelFor(size_t count, Func func, size_t minChunk = 4096) {
+  sharedWorkerPool().parallelFor(count, func, minChunk);
+}
+
+#endif